@@ -0,0 +1,215 @@
+/*  File: cache.c
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: on-disk cache of segment lists keyed by a hash of
+		the sequence and everything else that determines them.
+		Each entry is a file in the cache directory named by the
+		key in hex, holding "HEXCACH2", the key, then one record
+		in segment store format with an empty name.  Entries are
+		written to a temporary file and renamed, so several runs
+		can share a directory.  A hit touches the file, so the
+		modification times give the least recently used order.
+		When the total size passes the cap the directory is
+		scanned and the oldest entries removed down to 7/8 of it.
+ * Exported functions: see cache.h
+ * HISTORY:
+ * Created: Sun Oct 18 10:18:13 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "segstore.h"
+#include "cache.h"
+
+static char magic[] = "HEXCACH2" ;
+
+struct CacheStruct {
+  char *dir ;
+  long maxBytes, nBytes ;
+  long hits, misses ;
+  pthread_mutex_t lock ;	/* for the counts, and eviction */
+} ;
+
+uint64_t cacheHash (uint64_t h, void *data, long n)
+/* 8 bytes per multiply, much cheaper than scoring the sequence */
+{
+  unsigned char *p = (unsigned char*) data ;
+  uint64_t w ;
+
+  for ( ; n >= 8 ; n -= 8, p += 8)
+    { memcpy (&w, p, 8) ;
+      h = (h ^ w) * 0x9e3779b97f4a7c15ULL ;
+      h ^= h >> 29 ;
+    }
+  for ( ; n > 0 ; --n, ++p)
+    { h = (h ^ *p) * 0x100000001b3ULL ;
+      h ^= h >> 29 ;
+    }
+  h ^= h >> 32 ;		/* final mix, as in splitmix64 */
+  h *= 0xbf58476d1ce4e5b9ULL ;
+  return h ^ (h >> 29) ;
+}
+
+static char *entryName (Cache *c, uint64_t key)
+{
+  char *name = (char*) malloc (strlen (c->dir) + 18) ;
+
+  sprintf (name, "%s/%016llx", c->dir, (unsigned long long) key) ;
+  return name ;
+}
+
+typedef struct { char *name ; long size ; struct timespec mtime ; } Entry ;
+
+static int entryOrder (const void *a, const void *b)	/* oldest first */
+{
+  const struct timespec *x = &((Entry*)a)->mtime, *y = &((Entry*)b)->mtime ;
+
+  if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1 ;
+  return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec ;
+}
+
+static void scanDir (Cache *c, long target)
+/* recounts c->nBytes, removing the oldest entries until it is <= target */
+{
+  DIR *d ;
+  struct dirent *de ;
+  struct stat st ;
+  Entry *e = 0 ;
+  int i, n = 0, max = 0 ;
+  char *path = (char*) malloc (strlen (c->dir) + 258) ;
+
+  c->nBytes = 0 ;
+  if (!(d = opendir (c->dir)))
+    { free (path) ; return ; }
+  while ((de = readdir (d)))
+    { if (*de->d_name == '.') continue ; /* includes temporary files */
+      sprintf (path, "%s/%s", c->dir, de->d_name) ;
+      if (stat (path, &st) || !S_ISREG (st.st_mode)) continue ;
+      if (n == max)
+	{ max = 2*max + 256 ;
+	  e = (Entry*) realloc (e, max * sizeof(Entry)) ;
+	}
+      e[n].name = strdup (path) ;
+      e[n].size = st.st_size ;
+      e[n].mtime = st.st_mtim ;
+      c->nBytes += st.st_size ;
+      ++n ;
+    }
+  closedir (d) ;
+
+  if (c->nBytes > target)
+    qsort (e, n, sizeof(Entry), entryOrder) ;
+  for (i = 0 ; i < n ; ++i)
+    { if (c->nBytes > target && !unlink (e[i].name))
+	c->nBytes -= e[i].size ;
+      free (e[i].name) ;
+    }
+  free (e) ;
+  free (path) ;
+}
+
+/*****************************************************/
+
+Cache *cacheOpen (char *dir, long maxBytes)
+{
+  Cache *c ;
+  struct stat st ;
+
+  if (mkdir (dir, 0777) && errno != EEXIST) return 0 ;
+  if (stat (dir, &st) || !S_ISDIR (st.st_mode)) return 0 ;
+
+  c = (Cache*) calloc (1, sizeof(Cache)) ;
+  c->dir = strdup (dir) ;
+  c->maxBytes = maxBytes ;
+  pthread_mutex_init (&c->lock, 0) ;
+  scanDir (c, maxBytes) ;
+  return c ;
+}
+
+bool cacheGet (Cache *c, uint64_t key, SegRecord *r)
+{
+  FILE *fil ;
+  char buf[8], *name = entryName (c, key), *seqName = r->name ;
+  uint64_t k ;
+  int len = r->len ;
+  bool isHit = false ;
+
+  if ((fil = fopen (name, "rb")))
+    { r->name = 0 ;
+      isHit = fread (buf, 1, 8, fil) == 8 && !memcmp (buf, magic, 8) &&
+	fread (&k, sizeof(uint64_t), 1, fil) == 1 && k == key &&
+	segStoreRead (fil, r) == 1 && r->len == len ;
+      free (r->name) ;
+      r->name = seqName ;
+      r->len = len ;
+      if (isHit)
+	futimens (fileno (fil), 0) ; /* most recently used */
+      else
+	r->n = 0 ;
+      fclose (fil) ;
+    }
+  free (name) ;
+
+  pthread_mutex_lock (&c->lock) ;
+  if (isHit) ++c->hits ; else ++c->misses ;
+  pthread_mutex_unlock (&c->lock) ;
+  return isHit ;
+}
+
+void cachePut (Cache *c, uint64_t key, SegRecord *r)
+/* failures only mean the entry is not cached */
+{
+  FILE *fil ;
+  int fd ;
+  char *name = entryName (c, key), *seqName = r->name ;
+  char *tmpName = (char*) malloc (strlen (c->dir) + 16) ;
+  long size ;
+  bool isOK ;
+
+  sprintf (tmpName, "%s/.tmpXXXXXX", c->dir) ;
+  if ((fd = mkstemp (tmpName)) >= 0 && (fil = fdopen (fd, "wb")))
+    { r->name = "" ;
+      isOK = fwrite (magic, 1, 8, fil) == 8 &&
+	fwrite (&key, sizeof(uint64_t), 1, fil) == 1 &&
+	segStoreWrite (fil, r) ;
+      r->name = seqName ;
+      size = ftell (fil) ;
+      if (fclose (fil) || !isOK || rename (tmpName, name))
+	unlink (tmpName) ;
+      else
+	{ pthread_mutex_lock (&c->lock) ;
+	  c->nBytes += size ;
+	  if (c->nBytes > c->maxBytes)
+	    scanDir (c, c->maxBytes - c->maxBytes/8) ;
+	  pthread_mutex_unlock (&c->lock) ;
+	}
+    }
+  else if (fd >= 0)
+    { close (fd) ; unlink (tmpName) ; }
+  free (tmpName) ;
+  free (name) ;
+}
+
+void cacheClose (Cache *c, long *hits, long *misses)
+{
+  if (!c) return ;
+  *hits = c->hits ;
+  *misses = c->misses ;
+  pthread_mutex_destroy (&c->lock) ;
+  free (c->dir) ;
+  free (c) ;
+}
+
+/**************** end of file ***************/
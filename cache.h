@@ -0,0 +1,27 @@
+/*  File: cache.h
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: on-disk cache of segment lists keyed by a hash of
+		the sequence and everything else that determines them
+ * Exported functions: cacheHash, cacheOpen, cacheGet, cachePut, cacheClose
+ * HISTORY:
+ * Created: Sun Oct 18 10:18:13 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+typedef struct CacheStruct Cache ;
+
+extern uint64_t cacheHash (uint64_t h, void *data, long n) ;
+				/* continues hash h over n bytes */
+extern Cache *cacheOpen (char *dir, long maxBytes) ;
+				/* makes dir if needed, returns 0 on failure */
+extern bool cacheGet (Cache *c, uint64_t key, SegRecord *r) ;
+				/* fills r->segs if key is cached with length
+				   r->len; keeps r->name */
+extern void cachePut (Cache *c, uint64_t key, SegRecord *r) ;
+				/* may evict least recently used entries */
+extern void cacheClose (Cache *c, long *hits, long *misses) ;
+
+/***** end of file *****/
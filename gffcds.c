@@ -0,0 +1,187 @@
+/*  File: gffcds.c
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: CDS features from GFF3 or GTF, grouped into transcripts,
+		and spliced in frame out of index coded genome sequence.
+		Only lines with type CDS are used.  The transcript is the
+		GTF transcript_id, else the GFF3 Parent, else the GFF3 ID,
+		else the CDS stands alone.  A CDS with several GFF3
+		Parents goes into each of their transcripts.  The phase of the 5'
+		CDS (the lowest on the plus strand, the highest on the
+		minus strand) gives the bases before the first codon.
+ * Exported functions: see gffcds.h
+ * HISTORY:
+ * Created: Sun Oct 18 10:20:48 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gffcds.h"
+
+static char *attribute (char *attr, char *key, char *ends)
+/* copy of the value of key in attr, up to one of ends, else 0 */
+{
+  char *s, *v ;
+  int n = strlen (key) ;
+
+  for (s = attr ; (s = strstr (s, key)) ; s += n)
+    if ((s == attr || s[-1] == ';' || s[-1] == ' ') && (s[n] == '=' || s[n] == ' '))
+      { s += n + 1 ;
+	if (*s == '"') ++s ;
+	n = strcspn (s, ends) ;
+	if (!(v = (char*) malloc (n+1))) return 0 ;
+	memcpy (v, s, n) ;
+	v[n] = 0 ;
+	return v ;
+      }
+  return 0 ;
+}
+
+static int cdsOrder (const void *a, const void *b)
+{
+  const Cds *x = (const Cds*) a, *y = (const Cds*) b ;
+  int c ;
+
+  if ((c = strcmp (x->seqName, y->seqName))) return c ;
+  if ((c = strcmp (x->txName, y->txName))) return c ;
+  return x->start < y->start ? -1 : x->start > y->start ;
+}
+
+static void cdsAdd (Cds **cds, int *n, int *max, Cds *c, char *txName)
+/* appends a copy of c in transcript txName */
+{
+  Cds *d ;
+
+  if (*n == *max)
+    { *max = 2 * *max + 1024 ;
+      if (!(*cds = (Cds*) realloc (*cds, *max * sizeof(Cds))))
+	{ fprintf (stderr, "MALLOC failure for %d CDS features - aborting\n", *max) ;
+	  exit (-1) ;
+	}
+    }
+  d = &(*cds)[(*n)++] ;
+  *d = *c ;
+  d->seqName = strdup (c->seqName) ;
+  d->txName = txName ;
+}
+
+Cds *gffReadCds (char *name, int *nCds)
+{
+  FILE *fil ;
+  char *line = 0, *field[9], *s, *t, *tx ;
+  size_t size = 0 ;
+  int i, n = 0, max = 0, nAlone = 0 ;
+  Cds *cds = 0, c ;
+
+  if (!(fil = fopen (name, "r"))) return 0 ;
+
+  while (getline (&line, &size, fil) > 0)
+    { if (*line == '#') continue ;
+      for (i = 0, s = line ; i < 9 && s ; ++i)
+	{ field[i] = s ;
+	  if ((s = strchr (s, '\t'))) *s++ = 0 ;
+	}
+      if (i < 8 || strcmp (field[2], "CDS")) continue ;
+      if (i == 8) field[8] = "" ;
+      field[8][strcspn (field[8], "\n")] = 0 ;
+
+      c.start = atoi (field[3]) ;
+      c.end = atoi (field[4]) ;
+      c.strand = *field[6] ;
+      c.phase = (*field[7] >= '0' && *field[7] <= '2') ? *field[7] - '0' : 0 ;
+      if (c.start < 1 || c.end < c.start || (c.strand != '+' && c.strand != '-'))
+	continue ;		/* unusable */
+      c.seqName = field[0] ;
+      if ((tx = attribute (field[8], "transcript_id", "\";")))
+	cdsAdd (&cds, &n, &max, &c, tx) ;
+      else if ((tx = attribute (field[8], "Parent", ";")))
+	{ for (s = tx ; *(t = s + strcspn (s, ",")) ; s = t+1) /* one per Parent */
+	    { *t = 0 ;
+	      cdsAdd (&cds, &n, &max, &c, strdup (s)) ;
+	    }
+	  cdsAdd (&cds, &n, &max, &c, strdup (s)) ;
+	  free (tx) ;
+	}
+      else if ((tx = attribute (field[8], "ID", ";")))
+	cdsAdd (&cds, &n, &max, &c, tx) ;
+      else
+	{ tx = (char*) malloc (24) ; /* a transcript of its own */
+	  sprintf (tx, "\t%d", nAlone++) ;
+	  cdsAdd (&cds, &n, &max, &c, tx) ;
+	}
+    }
+  free (line) ;
+  fclose (fil) ;
+
+  qsort (cds, n, sizeof(Cds), cdsOrder) ;
+  *nCds = n ;
+  return cds ;
+}
+
+int gffFindSeq (Cds *cds, int n, char *seqName)
+{
+  int lo = 0, hi = n ;		/* first with seqName >= the target */
+
+  while (lo < hi)
+    { int mid = (lo + hi) / 2 ;
+      if (strcmp (cds[mid].seqName, seqName) < 0) lo = mid + 1 ; else hi = mid ;
+    }
+  return (lo < n && !strcmp (cds[lo].seqName, seqName)) ? lo : -1 ;
+}
+
+int gffTranscriptEnd (Cds *cds, int n, int i)
+{
+  int j ;
+
+  for (j = i+1 ; j < n && !strcmp (cds[j].txName, cds[i].txName) &&
+	 !strcmp (cds[j].seqName, cds[i].seqName) ; ++j) ;
+  return j ;
+}
+
+int gffSplice (Cds *cds, int i, int j, char *seq, int len,
+	       char **buf, int *bufSize, char **start)
+{
+  int k, n = 0, phase ;
+  char *s, *t, c ;
+
+  for (k = i ; k < j ; ++k)
+    { if (cds[k].end > len) return -1 ;
+      n += cds[k].end - cds[k].start + 1 ;
+    }
+  if (n + 4 > *bufSize)
+    { *bufSize = 2*n + 4 ;
+      free (*buf) ;
+      if (!(*buf = (char*) malloc (*bufSize)))
+	{ fprintf (stderr, "MALLOC failure for transcript of length %d - aborting\n", n) ;
+	  exit (-1) ;
+	}
+    }
+
+  for (k = i, s = *buf ; k < j ; ++k)
+    { memcpy (s, seq + cds[k].start - 1, cds[k].end - cds[k].start + 1) ;
+      s += cds[k].end - cds[k].start + 1 ;
+    }
+  memset (s, 0, 4) ;		/* slack for the codon lookahead */
+
+  if (cds[i].strand == '-')
+    { for (s = *buf, t = *buf + n - 1 ; s < t ; ++s, --t)
+	{ c = *s ;		/* NB "3 -" does complement, leave N codes */
+	  *s = (*t & ~3) ? *t : 3 - *t ;
+	  *t = (c & ~3) ? c : 3 - c ;
+	}
+      if (s == t && !(*s & ~3)) *s = 3 - *s ;
+      phase = cds[j-1].phase ;
+    }
+  else
+    phase = cds[i].phase ;
+
+  if (phase > n) phase = n ;
+  *start = *buf + phase ;
+  return n - phase ;
+}
+
+/**************** end of file ***************/
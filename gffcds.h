@@ -0,0 +1,36 @@
+/*  File: gffcds.h
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: CDS features from GFF3 or GTF, grouped into transcripts,
+		and spliced in frame out of index coded genome sequence
+ * Exported functions: gffReadCds, gffFindSeq, gffTranscriptEnd, gffSplice
+ * HISTORY:
+ * Created: Sun Oct 18 10:20:48 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+typedef struct {
+  char *seqName ;
+  char *txName ;		/* transcript_id in GTF, a Parent in GFF3 */
+  int start, end ;		/* 1-based, inclusive, as in the file */
+  char strand ;
+  int phase ;			/* bases to skip to the first codon, 0 if '.' */
+} Cds ;
+
+extern Cds *gffReadCds (char *name, int *n) ;
+				/* sorted by seqName, txName, start;
+				   returns 0 if the file can't be read */
+extern int gffFindSeq (Cds *cds, int n, char *seqName) ;
+				/* first CDS on seqName, -1 if none */
+extern int gffTranscriptEnd (Cds *cds, int n, int i) ;
+				/* one past the last CDS of the transcript at i */
+extern int gffSplice (Cds *cds, int i, int j, char *seq, int len,
+		      char **buf, int *bufSize, char **start) ;
+				/* joins cds[i..j) of seq into *buf, reverse
+				   complemented if on the minus strand, sets
+				   *start to the first codon and returns the length
+				   from there, or -1 if off the end of seq */
+
+/***** end of file *****/
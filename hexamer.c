@@ -20,6 +20,14 @@
 #include <stdlib.h>
 #include <stdbool.h>		/* defines bool, true, false */
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>		/* for sysconf, ftruncate, fsync */
+#include <time.h>
+#include <pthread.h>
+#include "segstore.h"
+#include "twobit.h"
+#include "shuffle.h"
+#include "cache.h"
 
 /*-----------------------------------------------------------*/
 
@@ -70,28 +78,124 @@ static float makePartial (char *s, int len, float *tab, int skip, float *partial
   return score ;
 }
 
-/***** find and print maximal segments *****/
+/***** find maximal segments *****/
 
-static void printSeg (int x1, int x2, float score) ;
+#define BLOCK 64		/* positions per prefilter block */
 
-static int processPartial (int step, float thresh, bool isRC,
-			   int offset, float *partial, int len)
-/* returns the total length of segments */
+typedef struct {		/* scratch space, one per scoring thread */
+  float *partial ;
+  int *maxes, *mins ;
+  int size ;
+  float *bMin, *bMax, *preMin, *sufMax ; /* prefilter block envelopes */
+  float *bRise ;		/* largest rise within the block */
+  int *sufArg ;			/* rightmost block achieving sufMax */
+  int nBlock ;			/* allocated */
+  float locMax[BLOCK], locPreMin[BLOCK] ;
+  int locArg[BLOCK] ;
+  long nPos, nPruned ;		/* prefilter statistics */
+  float thresh ;		/* segments must score above this */
+  float *top ;			/* -K: min-heap of best scores in this sequence */
+  int nTop ;
+} Work ;
+
+static bool isPrefilter = false ;
+static long prefilterPos = 0, prefilterPruned = 0 ;
+static int topK = 0 ;		/* -K: report only the best topK segments */
+
+static void workSize (Work *w, int len)
+{
+  if (w->size < len)
+    { free (w->partial) ; w->partial = (float*) malloc (len * sizeof(float)) ;
+      if (!isPrefilter)
+	{ free (w->maxes) ; w->maxes = (int*) malloc (len * sizeof(int)) ;
+	  free (w->mins) ; w->mins = (int*) malloc (len * sizeof(int)) ;
+	}
+      if (!w->partial || (!isPrefilter && (!w->maxes || !w->mins)))
+	{ fprintf (stderr, "MALLOC failure for sequence length %d - aborting\n", len) ;
+	  exit (-1) ;
+	}
+      w->size = len ;
+    }
+  if (isPrefilter && w->nBlock < len/BLOCK + 1)
+    { w->nBlock = len/BLOCK + 1 ;
+      free (w->bMin) ; w->bMin = (float*) malloc (w->nBlock * sizeof(float)) ;
+      free (w->bMax) ; w->bMax = (float*) malloc (w->nBlock * sizeof(float)) ;
+      free (w->preMin) ; w->preMin = (float*) malloc (w->nBlock * sizeof(float)) ;
+      free (w->sufMax) ; w->sufMax = (float*) malloc (w->nBlock * sizeof(float)) ;
+      free (w->sufArg) ; w->sufArg = (int*) malloc (w->nBlock * sizeof(int)) ;
+      free (w->bRise) ; w->bRise = (float*) malloc (w->nBlock * sizeof(float)) ;
+      if (!w->bMin || !w->bMax || !w->preMin || !w->sufMax || !w->sufArg || !w->bRise)
+	{ fprintf (stderr, "MALLOC failure for %d blocks - aborting\n", w->nBlock) ;
+	  exit (-1) ;
+	}
+    }
+}
+
+static void workTotals (Work *w)	/* add w's statistics to the global totals */
+{
+  prefilterPos += w->nPos ;
+  prefilterPruned += w->nPruned ;
+}
+
+static void workFree (Work *w)
+{
+  free (w->partial) ; free (w->maxes) ; free (w->mins) ;
+  free (w->bMin) ; free (w->bMax) ; free (w->preMin) ; free (w->sufMax) ; free (w->sufArg) ;
+  free (w->bRise) ; free (w->top) ;
+}
+
+static void segKeep (Work *w, SegRecord *rec, int x1, int x2, float score, char strand)
+/* segAdd, and with -K raise w->thresh as segments are found: once topK
+   segments of this sequence score above some x, no later segment scoring
+   <= x can be in the best topK.  Earlier ones scoring below x are dropped
+   when rec fills, so rec stays proportional to topK.  Ones equal to x are
+   kept, since they win ties with later segments.
+*/
+{
+  int i, j ;
+  float *h = w->top ;
+
+  segAdd (rec, x1, x2, score, strand) ;
+  if (!topK) return ;
+
+  if (w->nTop < topK)		/* sift up */
+    { for (i = w->nTop++ ; i && h[(i-1)/2] > score ; i = (i-1)/2)
+	h[i] = h[(i-1)/2] ;
+      h[i] = score ;
+    }
+  else if (score > h[0])	/* replace the root and sift down */
+    { for (i = 0 ; (j = 2*i+1) < topK ; i = j)
+	{ if (j+1 < topK && h[j+1] < h[j]) ++j ;
+	  if (h[j] >= score) break ;
+	  h[i] = h[j] ;
+	}
+      h[i] = score ;
+    }
+  if (w->nTop == topK && h[0] > w->thresh)
+    w->thresh = h[0] ;
+
+  if (rec->n >= 2*topK + 64)	/* drop those that can no longer make it */
+    { for (i = j = 0 ; i < rec->n ; ++i)
+	if (rec->segs[i].score >= w->thresh)
+	  rec->segs[j++] = rec->segs[i] ;
+      rec->n = j ;
+    }
+}
+
+static void processPartial (int step, bool isRC,
+			    int offset, float *partial, int len,
+			    Work *w, SegRecord *rec)
+/* adds maximal segments scoring above w->thresh to rec */
 { 
   int i, k ;
   int loclen ;
-  static int *maxes = 0, *mins = 0, slen = 0 ;
+  int *maxes = w->maxes, *mins = w->mins ;
+  char strand = isRC ? '-' : '+' ;
 
   loclen = len - offset ;
   while (loclen % step) --loclen ;
   partial += offset ;
 
-  if (slen < len)
-    { if (maxes) free (maxes) ; maxes = (int*) malloc (len * sizeof(int)) ;
-      if (mins) free (mins) ; mins = (int*) malloc (len * sizeof(int)) ;
-      slen = len ;
-    }
-
   k = 3 ;					/* make mins */
   for (i = 3 ; i <= loclen-3 ; i += step)
     { if (partial[i] < partial[k]) k = i ;
@@ -103,19 +207,258 @@ static int processPartial (int step, float thresh, bool isRC,
       maxes[i] = k ;
     }
 
-  int total = 0 ;
   for (i = 3 ; i <= loclen - 3 ; i += step)
     if (mins[maxes[i]] == i && 
-	partial[maxes[i]] - partial[i] > thresh)
-      { total += maxes[i] - i ;
-	if (isRC)
-	  printSeg (len-1 - maxes[i] - offset, len-1 - i - offset,
-		    partial[maxes[i]] - partial[i]) ;
+	partial[maxes[i]] - partial[i] > w->thresh)
+      { if (isRC)
+	  segKeep (w, rec, len-1 - maxes[i] - offset, len-1 - i - offset,
+		   partial[maxes[i]] - partial[i], strand) ;
 	else
-	  printSeg (i + offset, maxes[i] + offset, partial[maxes[i]] - partial[i]) ;
+	  segKeep (w, rec, i + offset, maxes[i] + offset,
+		   partial[maxes[i]] - partial[i], strand) ;
       }
-  
-  return total ;
+}
+
+/* Prefilter version of processPartial, giving identical output.
+   processPartial reports i when i is the first minimum of partial up to
+   m = maxes[i], the last maximum from i on, and partial[m]-partial[i] > thresh.
+   Here the positions are cut into blocks of BLOCK.  A segment starting in
+   block b scores at most the largest rise within b if it ends in b, or
+   the maximum after b minus the minimum in b if not.  Blocks where both
+   are <= thresh are skipped.  In the others m and the minimum up to m
+   are found from the block envelopes plus a scan of one block.
+*/
+
+static void processPartialPrefilter (int step, bool isRC,
+				     int offset, float *partial, int len,
+				     Work *w, SegRecord *rec)
+{
+  int b, c, j, k, m, n, nb, first, last, cm = 0, lastC = -1 ;
+  int loclen ;
+  float x, pm, cpm = 0 ;
+  float *p ;
+  char strand = isRC ? '-' : '+' ;
+
+  loclen = len - offset ;
+  while (loclen % step) --loclen ;
+  partial += offset ;
+  p = partial + 3 ;		/* p[j*step] is position 3 + j*step */
+  n = loclen - 3 < 3 ? 0 : (loclen - 6) / step + 1 ;
+  nb = (n + BLOCK - 1) / BLOCK ;
+
+  for (b = 0 ; b < nb ; ++b)	/* coarse pass: block envelopes */
+    { first = b*BLOCK ; last = first + BLOCK < n ? first + BLOCK : n ;
+      w->bMin[b] = w->bMax[b] = p[first*step] ;
+      w->bRise[b] = 0 ;
+      for (j = first+1 ; j < last ; ++j)
+	{ x = p[j*step] ;
+	  if (x < w->bMin[b]) w->bMin[b] = x ;
+	  if (x > w->bMax[b]) w->bMax[b] = x ;
+	  if (x - w->bMin[b] > w->bRise[b]) w->bRise[b] = x - w->bMin[b] ;
+	}
+      w->preMin[b] = (b && w->preMin[b-1] < w->bMin[b]) ? w->preMin[b-1] : w->bMin[b] ;
+    }
+  for (b = nb ; b-- ;)
+    if (b == nb-1 || w->bMax[b] > w->sufMax[b+1])
+      { w->sufMax[b] = w->bMax[b] ; w->sufArg[b] = b ; }
+    else
+      { w->sufMax[b] = w->sufMax[b+1] ; w->sufArg[b] = w->sufArg[b+1] ; }
+
+  w->nPos += n ;
+  for (b = 0 ; b < nb ; ++b)
+    { first = b*BLOCK ; last = first + BLOCK < n ? first + BLOCK : n ;
+      if (!(w->bRise[b] > w->thresh) &&
+	  (b+1 == nb || !(w->sufMax[b+1] - w->bMin[b] > w->thresh)))
+	{ w->nPruned += last - first ; continue ; }
+
+      k = last - 1 ;		/* last maximum from each j within the block */
+      for (j = last ; j-- > first ;)
+	{ if (p[j*step] > p[k*step]) k = j ;
+	  w->locMax[j-first] = p[k*step] ;
+	  w->locArg[j-first] = k ;
+	}
+      pm = b ? w->preMin[b-1] : p[first*step] ; /* minimum up to each j */
+      for (j = first ; j < last ; ++j)
+	{ if (p[j*step] < pm) pm = p[j*step] ;
+	  w->locPreMin[j-first] = pm ;
+	}
+
+      for (j = first ; j < last ; ++j)
+	{ if (j && !(p[j*step] < (j == first ? w->preMin[b-1] : w->locPreMin[j-first-1])))
+	    continue ;		/* not a new first minimum */
+	  if (b+1 < nb && w->sufMax[b+1] >= w->locMax[j-first])
+	    { c = w->sufArg[b+1] ;
+	      if (c != lastC)	/* last maximum in block c, and minimum up to it */
+		{ int cFirst = c*BLOCK, cLast = cFirst + BLOCK < n ? cFirst + BLOCK : n ;
+		  for (cm = cLast ; p[--cm*step] != w->bMax[c] ;) ;
+		  for (cpm = w->preMin[c-1], k = cFirst ; k <= cm ; ++k)
+		    if (p[k*step] < cpm) cpm = p[k*step] ;
+		  lastC = c ;
+		}
+	      m = cm ; pm = cpm ;
+	    }
+	  else
+	    { m = w->locArg[j-first] ; pm = w->locPreMin[m-first] ; }
+	  if (p[m*step] - p[j*step] > w->thresh && p[j*step] <= pm)
+	    { int i = 3 + j*step, mx = 3 + m*step ;
+	      if (isRC)
+		segKeep (w, rec, len-1 - mx - offset, len-1 - i - offset,
+			 partial[mx] - partial[i], strand) ;
+	      else
+		segKeep (w, rec, i + offset, mx + offset, partial[mx] - partial[i], strand) ;
+	    }
+	}
+    }
+}
+
+/***** score both strands of one sequence *****/
+
+static float *tab = 0 ;
+static int step = 3 ;
+static float floorThresh = 0.0 ;	/* lowest threshold requested */
+
+static void scoreSequence (char *seq, int len, Work *w, SegRecord *rec)
+/* adds segments above w->thresh to rec, reverse complements seq in place */
+{
+  int i ;
+  char c ;
+  bool isRC ;
+
+  workSize (w, len) ;
+  if (topK)
+    { if (!w->top) w->top = (float*) malloc (topK * sizeof(float)) ;
+      w->nTop = 0 ;
+    }
+				/* first do forward direction */
+  isRC = false ;
+  for (i = 0 ; i < step ; ++i)
+    makePartial (seq+i, len-i, tab, step, w->partial+i) ;
+  for (i = 0 ; i < step ; ++i)
+    if (isPrefilter)
+      processPartialPrefilter (step, isRC, i, w->partial, len, w, rec) ;
+    else
+      processPartial (step, isRC, i, w->partial, len, w, rec) ;
+
+				/* then reverse complement */
+  isRC = true ;
+  for (i = 0 ; i < len-1-i ; ++i)
+    { c = 3 - seq[i] ;	/* NB "3 -" does complement */
+      seq[i] = 3 - seq[len-1-i] ; 
+      seq[len-1-i] = c ; 
+    }
+  for (i = 0 ; i < step ; ++i)
+    makePartial (seq+i, len-i, tab, step, w->partial+i) ;
+  for (i = 0 ; i < step ; ++i)
+    if (isPrefilter)
+      processPartialPrefilter (step, isRC, i, w->partial, len, w, rec) ;
+    else
+      processPartial (step, isRC, i, w->partial, len, w, rec) ;
+}
+
+/***** reuse of segments found in earlier runs *****/
+
+static Cache *cache = 0 ;
+static uint64_t modeHash ;	/* of the table, floorThresh and step */
+
+static void makeModeHash (void)
+{
+  modeHash = cacheHash (0, tab, 4096 * sizeof(float)) ;
+  modeHash = cacheHash (modeHash, &floorThresh, sizeof(float)) ;
+  modeHash = cacheHash (modeHash, &step, sizeof(int)) ;
+}
+
+static void scoreCached (char *seq, int len, Work *w, SegRecord *rec)
+/* as scoreSequence, but rec->segs come from the cache if it has them */
+{
+  uint64_t key ;
+
+  if (!cache)
+    { scoreSequence (seq, len, w, rec) ; return ; }
+  key = cacheHash (cacheHash (modeHash, &len, sizeof(int)), seq, len) ;
+  if (cacheGet (cache, key, rec))
+    return ;
+  scoreSequence (seq, len, w, rec) ;
+  cachePut (cache, key, rec) ;
+}
+
+/***** empirical null from shuffled copies *****/
+
+static int nShuffle = 0 ;	/* shuffles per sequence, 0 for no calibration */
+static bool isDinuc = false ;	/* dinucleotide rather than codon shuffles */
+static uint64_t seed = 1 ;
+
+static int floatOrder (const void *a, const void *b)
+{
+  float x = *(float*)a, y = *(float*)b ;
+
+  return x < y ? -1 : x > y ;
+}
+
+static void nullSize (SegRecord *rec)
+{
+  if (rec->maxNull < nShuffle)
+    { free (rec->null) ;
+      rec->null = (float*) malloc (nShuffle * sizeof(float)) ;
+      rec->maxNull = nShuffle ;
+    }
+}
+
+static void shuffleScores (char *seq, int len, long serial, int k0, int k1,
+			   Work *w, float *null)
+/* puts the best segment score in shuffles k0..k1-1 of seq into null[k],
+   with floorThresh standing for no segment above it; shuffle k of
+   sequence serial is the same whatever the threading, and seq is
+   left unchanged
+*/
+{
+  int i, k ;
+  char *copy ;
+  uint64_t rng ;
+  SegRecord shuf ;
+
+  copy = (char*) malloc (len + 4) ;
+  memset (copy + len, 0, 4) ;	/* makePartial may look past the end */
+  memset (&shuf, 0, sizeof(shuf)) ;
+  w->thresh = floorThresh ;
+
+  for (k = k0 ; k < k1 ; ++k)
+    { memcpy (copy, seq, len) ;
+      rng = shuffleSeed (seed, serial, k) ;
+      if (isDinuc)
+	shuffleDinucleotides (copy, len, &rng) ;
+      else
+	shuffleCodons (copy, len, &rng) ;
+      shuf.n = 0 ;
+      scoreSequence (copy, len, w, &shuf) ;
+      null[k] = floorThresh ;
+      for (i = 0 ; i < shuf.n ; ++i)
+	if (shuf.segs[i].score > null[k])
+	  null[k] = shuf.segs[i].score ;
+    }
+
+  free (copy) ;
+  free (shuf.segs) ;
+}
+
+static void calibrateSequence (char *seq, int len, long serial, Work *w, SegRecord *rec)
+/* all nShuffle shuffle scores of seq into rec->null, sorted */
+{
+  nullSize (rec) ;
+  shuffleScores (seq, len, serial, 0, nShuffle, w, rec->null) ;
+  rec->nNull = nShuffle ;
+  qsort (rec->null, nShuffle, sizeof(float), floatOrder) ;
+}
+
+static double pValue (SegRecord *r, float score)
+/* (1 + shuffles with a segment scoring >= score) / (1 + shuffles) */
+{
+  int lo = 0, hi = r->nNull, mid ;
+
+  while (lo < hi)
+    { mid = (lo + hi) / 2 ;
+      if (r->null[mid] < score) lo = mid + 1 ; else hi = mid ;
+    }
+  return (1.0 + r->nNull - lo) / (1.0 + r->nNull) ;
 }
 
 /****************************************************************/
@@ -127,48 +470,782 @@ static int processPartial (int step, float thresh, bool isRC,
 static void usage (void)
 {
   fprintf (stdout, "Usage: hexamer [opts] <tableFile> <seqFile>\n") ;
-  fprintf (stdout, "options: -T <threshold>      0\n") ;
+  fprintf (stdout, "       seqFile is fasta, - for stdin, or .2bit, or file.2bit:seqName for one sequence\n") ;
+  fprintf (stdout, "       hexamer [opts] -R <storeFile>\n") ;
+  fprintf (stdout, "       hexamer [-o <file>] --merge <shard outputs in order>\n") ;
+  fprintf (stdout, "options: -T <threshold>[,<threshold>...]  0\n") ;
   fprintf (stdout, "         -F <feature name>   tableFile name\n") ;
   fprintf (stdout, "         -n	                 flag for noncoding (no triplet frame)\n") ;
   fprintf (stdout, "         -S                  flag to output sum per sequence, not individual segments\n") ;
+  fprintf (stdout, "         -K <n>              report the n best segments above threshold, best first\n") ;
+  fprintf (stdout, "         -O                  flag to output each sequence's segments in coordinate order\n") ;
+  fprintf (stdout, "         -W <storeFile>      also store all segments above the lowest threshold\n") ;
+  fprintf (stdout, "         -R <storeFile>      report segments from storeFile, without rescanning\n") ;
+  fprintf (stdout, "         -P                  flag to skip blocks that cannot reach threshold, same output\n") ;
+  fprintf (stdout, "         -C <n>              calibrate with n shuffles per sequence, adds p-values\n") ;
+  fprintf (stdout, "         -D                  flag for dinucleotide, not codon, shuffles\n") ;
+  fprintf (stdout, "         -A <fpr>            false positive rate for the suggested threshold   0.05\n") ;
+  fprintf (stdout, "         -z <seed>           random seed for shuffles   1\n") ;
+  fprintf (stdout, "         -o <file>           output file, not stdout\n") ;
+  fprintf (stdout, "         --checkpoint <file> save progress here, needs -o and a seqFile\n") ;
+  fprintf (stdout, "         --every <secs>      interval between checkpoints   60\n") ;
+  fprintf (stdout, "         --resume            continue from the checkpoint, same options and files\n") ;
+  fprintf (stdout, "         --shard <i>/<N>     scan only shard i of N of seqFile, i from 1\n") ;
+  fprintf (stdout, "         --cache <dir>       reuse segments of sequences already scanned with this table\n") ;
+  fprintf (stdout, "         --cache-size <MB>   size cap, least recently used entries go first   1024\n") ;
+  fprintf (stdout, "         -j <threads>        scoring threads, with separate reader and writer threads\n") ;
+  fprintf (stdout, "         -Q <depth>          sequences in flight between reader and writer   4*threads\n") ;
   exit (-1) ;
 }
 
-static char *seqName = "" ;
 static char *tableName ;
 static char *featName ;
-static char strand ;
 static char frame = '0' ;
 static bool isTotal = false ;
+static bool isCoordOrder = false ;
+
+#define MAX_THRESH 64
 
-static void printSeg (int x1, int x2, float score)
+static int parseThresholds (char *text, float *thresh)
+/* comma separated list, returns the number found, lowest first */
 {
-  if (isTotal) return ;
-  printf ("%s\t%s\t%s\t%d\t%d\t%.4f\t%c\t%c\n", 
-	  seqName, "hexamer", featName, x1+1, x2+1, 
-	  score, strand, frame) ;
+  int i, n = 0 ;
+  char *end ;
+  float x ;
+
+  while (n < MAX_THRESH)
+    { x = strtod (text, &end) ;
+      if (end == text) return 0 ;
+      for (i = n++ ; i && thresh[i-1] > x ; --i) thresh[i] = thresh[i-1] ;
+      thresh[i] = x ;
+      if (!*end) return n ;
+      if (*end != ',') return 0 ;
+      text = end + 1 ;
+    }
+  return 0 ;
 }
 
-int main (int argc, char *argv[])
+/* Segments come in runs, one per strand and frame: each plus strand run
+   is in increasing x1, each minus strand run in decreasing x1.  coordOrder
+   finds the maximal such runs, so it also works on a record from a store,
+   and merges them by x1, then x2, then run.  There are at most six runs,
+   so the next segment is found by looking at the head of each.
+*/
+
+typedef struct { int next, end, dir ; } SegRun ;
+
+static void coordOrder (SegRecord *r)
+{
+  static Seg *buf = 0 ;
+  static SegRun *run = 0 ;
+  static int bufMax = 0, runMax = 0 ;
+  int i, j, k, nRun = 0, dir ;
+  Seg *a, *b = 0 ;
+
+  if (r->n < 2) return ;
+  if (r->n > bufMax)
+    { bufMax = 2*r->n ;
+      free (buf) ; buf = (Seg*) malloc (bufMax * sizeof(Seg)) ;
+    }
+  for (i = 0 ; i < r->n ; i = j)	/* find the runs */
+    { dir = r->segs[i].strand == '-' ? -1 : 1 ;
+      for (j = i+1 ; j < r->n && r->segs[j].strand == r->segs[i].strand &&
+	     (r->segs[j].x1 - r->segs[j-1].x1) * dir > 0 ; ++j) ;
+      if (nRun == runMax)
+	{ runMax = 2*runMax + 6 ;
+	  run = (SegRun*) realloc (run, runMax * sizeof(SegRun)) ;
+	}
+      run[nRun].dir = dir ;
+      if (dir > 0) { run[nRun].next = i ; run[nRun].end = j ; }
+      else { run[nRun].next = j-1 ; run[nRun].end = i-1 ; }
+      ++nRun ;
+    }
+  if (nRun == 1 && run[0].dir > 0) return ; /* already in order */
+
+  for (i = 0 ; i < r->n ; ++i)		/* merge */
+    { for (k = -1, j = 0 ; j < nRun ; ++j)
+	if (run[j].next != run[j].end)
+	  { a = &r->segs[run[j].next] ;
+	    if (k < 0 || a->x1 < b->x1 || (a->x1 == b->x1 && a->x2 < b->x2))
+	      { k = j ; b = a ; }
+	  }
+      buf[i] = *b ;
+      run[k].next += run[k].dir ;
+    }
+  memcpy (r->segs, buf, r->n * sizeof(Seg)) ;
+}
+
+static void printSeg (char *name, Seg *s)	/* a GFF line, without the newline */
+{
+  printf ("%s\t%s\t%s\t%d\t%d\t%.4f\t%c\t%c", 
+	  name, "hexamer", featName, s->x1+1, s->x2+1, 
+	  s->score, s->strand, frame) ;
+}
+
+static int reportRecord (SegRecord *r, float thresh)
+/* prints segments scoring above thresh, returns their total length */
+{
+  int i, total = 0 ;
+  Seg *s ;
+
+  if (isCoordOrder && !isTotal)
+    coordOrder (r) ;
+  for (i = 0, s = r->segs ; i < r->n ; ++i, ++s)
+    if (s->score > thresh)
+      { total += s->x2 - s->x1 ;
+	if (isTotal)
+	  continue ;
+	printSeg (r->name, s) ;
+	if (r->nNull)
+	  printf ("\tpvalue %.3g", pValue (r, s->score)) ;
+	putchar ('\n') ;
+      }
+  if (isTotal) printf ("%s\t%d\t%d\n", r->name, r->len, total) ;
+
+  return total ;
+}
+
+static void reportStore (FILE *store, long start, float *thresh, int nThresh)
+/* one pass through the store from start for each threshold */
+{
+  int t, res ;
+  long count, sumTotal, sumLength ;
+  SegRecord r ;
+
+  memset (&r, 0, sizeof(r)) ;
+  for (t = 0 ; t < nThresh ; ++t)
+    { if (fseek (store, start, SEEK_SET))
+	{ fprintf (stderr, "Failed to rewind segment store\n") ;
+	  exit (-1) ;
+	}
+      if (nThresh > 1) printf ("##threshold %g\n", thresh[t]) ;
+      count = sumTotal = sumLength = 0 ;
+      while ((res = segStoreRead (store, &r)) > 0)
+	{ sumTotal += reportRecord (&r, thresh[t]) ;
+	  sumLength += r.len ;
+	  ++count ;
+	}
+      if (res < 0)
+	{ fprintf (stderr, "Truncated or bad record %ld in segment store\n", count+1) ;
+	  exit (-1) ;
+	}
+      if (nThresh > 1) fprintf (stderr, "threshold %g: ", thresh[t]) ;
+      fprintf (stderr, "%ld sequences %ld sumLength %ld sumTotal\n", count, sumLength, sumTotal) ;
+    }
+  free (r.name) ;
+  free (r.segs) ;
+  free (r.null) ;
+}
+
+/***** per-sequence output, always called in input order *****/
+
+static FILE *store = 0 ;
+static float thresh[MAX_THRESH] ;
+static int nThresh = 0 ;
+static long count = 0, sumTotal = 0, sumLength = 0 ;
+
+/***** -K: the best topK segments over all sequences *****/
+
+/* A min-heap ordered by score, then later before earlier, so the root
+   is the first to go.  Records arrive in input order, so ties are kept
+   in favour of the earlier segment, whatever the threading.  topMin is
+   the root score once the heap is full: scorers need only report
+   segments above it, and it only rises.
+*/
+
+typedef struct {
+  Seg seg ;
+  char *name ;
+  long order ;			/* arrival */
+} TopSeg ;
+
+static TopSeg *topHeap = 0 ;
+static int nTopHeap = 0 ;
+static long nTopOrder = 0 ;
+static float topMin ;
+static pthread_mutex_t topLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static bool topWorse (TopSeg *a, TopSeg *b)
+{
+  return a->seg.score < b->seg.score ||
+    (a->seg.score == b->seg.score && a->order > b->order) ;
+}
+
+static float topThreshold (void)	/* for the scorers */
+{
+  float t ;
+
+  if (!topK) return floorThresh ;
+  pthread_mutex_lock (&topLock) ;
+  t = topMin ;
+  pthread_mutex_unlock (&topLock) ;
+  return t ;
+}
+
+static void topAdd (SegRecord *r)
+{
+  int i, j, k ;
+  TopSeg x, *h = topHeap ;
+
+  for (k = 0 ; k < r->n ; ++k)
+    { x.seg = r->segs[k] ;
+      x.order = nTopOrder++ ;
+      if (nTopHeap < topK)	/* sift up */
+	{ x.name = strdup (r->name) ;
+	  for (i = nTopHeap++ ; i && topWorse (&x, &h[(i-1)/2]) ; i = (i-1)/2)
+	    h[i] = h[(i-1)/2] ;
+	  h[i] = x ;
+	}
+      else if (x.seg.score > h[0].seg.score) /* x is later, so must score more */
+	{ free (h[0].name) ;
+	  x.name = strdup (r->name) ;
+	  for (i = 0 ; (j = 2*i+1) < topK ; i = j)
+	    { if (j+1 < topK && topWorse (&h[j+1], &h[j])) ++j ;
+	      if (!topWorse (&h[j], &x)) break ;
+	      h[i] = h[j] ;
+	    }
+	  h[i] = x ;
+	}
+    }
+  if (nTopHeap == topK && h[0].seg.score > topMin)
+    { pthread_mutex_lock (&topLock) ;
+      topMin = h[0].seg.score ;
+      pthread_mutex_unlock (&topLock) ;
+    }
+}
+
+static int topOrder (const void *a, const void *b)	/* best first */
+{
+  return topWorse ((TopSeg*)b, (TopSeg*)a) ? -1 : topWorse ((TopSeg*)a, (TopSeg*)b) ;
+}
+
+static long reportTop (void)	/* returns the total length */
 {
   int i ;
-  float thresh = 0.0 ;
-  float *tab = 0, *partial ;
-  int step = 3 ;
-  FILE *seqFile ;
+  long total = 0 ;
+
+  qsort (topHeap, nTopHeap, sizeof(TopSeg), topOrder) ;
+  for (i = 0 ; i < nTopHeap ; ++i)
+    { printSeg (topHeap[i].name, &topHeap[i].seg) ;
+      putchar ('\n') ;
+      total += topHeap[i].seg.x2 - topHeap[i].seg.x1 ;
+      free (topHeap[i].name) ;
+    }
+  free (topHeap) ;
+  return total ;
+}
+
+static float *nullAll = 0 ;	/* calibration scores from all sequences */
+static long nNullAll = 0, maxNullAll = 0 ;
+static double fpr = 0.05 ;
+
+/***** checkpoints, so that a long run can be resumed *****/
+
+/* A checkpoint records, after some sequence, the input position of the
+   next one, the running totals, and the lengths of the output, segment
+   store and calibration score files.  Resuming truncates those files
+   back, restores the totals and seeks the input, so the output is the
+   same as from an uninterrupted run.  The checkpoint is written to a
+   temporary file and renamed, after syncing the files it refers to.
+*/
+
+static char *ckptName = 0 ;
+static int ckptEvery = 60 ;	/* seconds */
+static time_t ckptLast = 0 ;
+static char ckptArgs[1024] ;	/* options and files, must match on resume */
+static FILE *nullFile = 0 ;	/* calibration scores, when checkpointing */
+
+static void syncFile (FILE *fil)
+{
+  if (fil && (fflush (fil) || fsync (fileno (fil))))
+    { fprintf (stderr, "Failed to sync output before checkpoint\n") ;
+      exit (-1) ;
+    }
+}
+
+static void checkpoint (long nextPos)
+{
+  FILE *fil ;
+  char *tmpName = (char*) malloc (strlen (ckptName) + 5) ;
+
+  syncFile (stdout) ;
+  syncFile (store) ;
+  syncFile (nullFile) ;
+
+  sprintf (tmpName, "%s.tmp", ckptName) ;
+  if (!(fil = fopen (tmpName, "w")))
+    { fprintf (stderr, "Failed to write checkpoint %s\n", tmpName) ;
+      exit (-1) ;
+    }
+  fprintf (fil, "hexamer checkpoint\nargs %s\ninput %ld\ncount %ld\nsumLength %ld\n"
+	   "sumTotal %ld\noutput %ld\nstore %ld\nnull %ld\n",
+	   ckptArgs, nextPos, count, sumLength, sumTotal,
+	   ftell (stdout), store ? ftell (store) : 0L, nNullAll) ;
+  if (fflush (fil) || fsync (fileno (fil)) || fclose (fil) || rename (tmpName, ckptName))
+    { fprintf (stderr, "Failed to write checkpoint %s\n", ckptName) ;
+      exit (-1) ;
+    }
+  free (tmpName) ;
+  ckptLast = time (0) ;
+}
+
+typedef struct { long input, output, store ; } ResumePoint ;
+
+static ResumePoint readCheckpoint (void)
+/* restores the totals and calibration scores, returns the file positions */
+{
+  FILE *fil ;
+  char args[1024] ;
+  ResumePoint rp ;
+
+  if (!(fil = fopen (ckptName, "r")))
+    { fprintf (stderr, "No checkpoint %s to resume from\n", ckptName) ;
+      exit (-1) ;
+    }
+  if (fscanf (fil, "hexamer checkpoint args %1023[^\n] input %ld count %ld sumLength %ld"
+	      " sumTotal %ld output %ld store %ld null %ld",
+	      args, &rp.input, &count, &sumLength, &sumTotal,
+	      &rp.output, &rp.store, &nNullAll) != 8)
+    { fprintf (stderr, "Bad checkpoint file %s\n", ckptName) ;
+      exit (-1) ;
+    }
+  fclose (fil) ;
+  if (strcmp (args, ckptArgs))
+    { fprintf (stderr, "Checkpoint %s was made by a different command: %s\n", ckptName, args) ;
+      exit (-1) ;
+    }
+
+  if (nNullAll)
+    { maxNullAll = nNullAll ;
+      nullAll = (float*) malloc (nNullAll * sizeof(float)) ;
+      if (!nullFile || fread (nullAll, sizeof(float), nNullAll, nullFile) != nNullAll)
+	{ fprintf (stderr, "Failed to read calibration scores for checkpoint\n") ;
+	  exit (-1) ;
+	}
+    }
+  if (nullFile && ftruncate (fileno (nullFile), nNullAll * sizeof(float)))
+    { fprintf (stderr, "Failed to truncate calibration scores for checkpoint\n") ;
+      exit (-1) ;
+    }
+
+  return rp ;
+}
+
+static void finishRecord (SegRecord *r, long nextPos)
+/* nextPos is the input position after r, for checkpoints */
+{
+  if (r->nNull)
+    { if (nNullAll + r->nNull > maxNullAll)
+	{ maxNullAll = 2*maxNullAll + r->nNull ;
+	  if (!(nullAll = (float*) realloc (nullAll, maxNullAll * sizeof(float))))
+	    { fprintf (stderr, "MALLOC failure for calibration scores - aborting\n") ;
+	      exit (-1) ;
+	    }
+	}
+      memcpy (nullAll + nNullAll, r->null, r->nNull * sizeof(float)) ;
+      nNullAll += r->nNull ;
+      if (nullFile && fwrite (r->null, sizeof(float), r->nNull, nullFile) != r->nNull)
+	{ fprintf (stderr, "Failed to save calibration scores\n") ;
+	  exit (-1) ;
+	}
+    }
+  if (store && !segStoreWrite (store, r))
+    { fprintf (stderr, "Failed to write segment store at sequence %s\n", r->name) ;
+      exit (-1) ;
+    }
+  if (topK)
+    topAdd (r) ;
+  else if (nThresh == 1)
+    sumTotal += reportRecord (r, thresh[0]) ;
+  sumLength += r->len ;
+  ++count ;
+  if (ckptName && time (0) - ckptLast >= ckptEvery)
+    checkpoint (nextPos) ;
+}
+
+static void reportCalibration (void)
+/* the suggested threshold is exceeded by at most fpr of the shuffles */
+{
+  static double q[] = { 0.5, 0.9, 0.95, 0.99, 0.999 } ;
+  int i ;
+  long k ;
+  float t ;
+
+  if (!nNullAll) return ;
+  qsort (nullAll, nNullAll, sizeof(float), floatOrder) ;
+  fprintf (stderr, "calibration: %ld %s shuffles, best segment score quantiles",
+	   nNullAll, isDinuc ? "dinucleotide" : "codon") ;
+  for (i = 0 ; i < sizeof(q)/sizeof(double) ; ++i)
+    fprintf (stderr, " %g%% %.2f", 100*q[i], nullAll[(long)(q[i]*(nNullAll-1))]) ;
+  fputc ('\n', stderr) ;
+  k = nNullAll - 1 - (long)(fpr * nNullAll) ;
+  if (k < 0) k = 0 ;
+  t = nullAll[k] ;
+  fprintf (stderr, "calibration: suggest -T %.2f for false positive rate %g per sequence%s\n",
+	   t, fpr, t > floorThresh ? "" : " (censored at -T, rerun lower)") ;
+}
+
+/***** sequence input: fasta, or .2bit with random access *****/
+
+static TwoBit *twoBit = 0 ;
+static int twoBitNext = 0, twoBitEnd = 0 ; /* .2bit records still to read */
+
+static long shardEnd = -1 ;	/* fasta shard ends before this offset */
+
+static bool nextSequence (FILE *fil, char **seq, char **name, int *len)
+{
+  if (!twoBit)
+    { if (shardEnd >= 0 && ftell (fil) >= shardEnd)
+	return false ;
+      return readSequence (fil, dna2indexConv, seq, name, 0, len) != 0 ;
+    }
+
+  if (twoBitNext >= twoBitEnd)
+    return false ;
+  if (twoBitRead (twoBit, twoBitNext, dna2indexConv['n'], seq, len) < 0)
+    { fprintf (stderr, "Corrupt .2bit record %s\n", twoBitName (twoBit, twoBitNext)) ;
+      exit (-1) ;
+    }
+  *name = strdup (twoBitName (twoBit, twoBitNext++)) ;
+  return true ;
+}
+
+static long inputPos (FILE *fil)	/* where the next sequence starts */
+{
+  return twoBit ? twoBitNext : ftell (fil) ;
+}
+
+static FILE *openSequences (char *name)
+/* sets twoBit and returns 0 for .2bit input, else returns the fasta file */
+{
+  FILE *fil ;
+  char *colon ;
+
+  if (!strcmp (name, "-"))
+    return stdin ;
+  if ((twoBit = twoBitOpen (name)))
+    { twoBitEnd = twoBitCount (twoBit) ;
+      return 0 ;
+    }
+  if ((fil = fopen (name, "r")))
+    return fil ;
+  for (colon = strchr (name, ':') ; colon ; colon = strchr (colon+1, ':'))
+    { *colon = 0 ;		/* file.2bit:seqName - seqName may contain ':' */
+      twoBit = twoBitOpen (name) ;
+      *colon = ':' ;
+      if (twoBit)
+	{ if ((twoBitNext = twoBitFind (twoBit, colon+1)) < 0)
+	    { fprintf (stderr, "Sequence %s not found in .2bit file\n", colon+1) ;
+	      exit (-1) ;
+	    }
+	  twoBitEnd = twoBitNext + 1 ;
+	  return 0 ;
+	}
+    }
+  fprintf (stderr, "Failed to open sequence file %s\n", name) ;
+  usage() ;
+  return 0 ;
+}
+
+static void openShard (FILE *fil, int i, int n)
+/* restricts input to shard i of n: a byte range snapped to record starts
+   for fasta, records split by total length for .2bit
+*/
+{
+  long start, total = 0, sum = 0 ;
+  int k, first = twoBitEnd ;
+
+  if (!twoBit)
+    { if (fil == stdin || !seqShard (fil, i, n, &start, &shardEnd))
+	{ fprintf (stderr, "Can't make shard %d/%d of the sequence file\n", i, n) ;
+	  exit (-1) ;
+	}
+      return ;
+    }
+
+  for (k = twoBitNext ; k < twoBitEnd ; ++k)
+    total += twoBitLength (twoBit, k) ;
+  for (k = twoBitNext ; k < twoBitEnd ; sum += twoBitLength (twoBit, k++))
+    if (sum >= total / n * (i-1) + total % n * (i-1) / n)
+      { if (first == twoBitEnd) first = k ;
+	if (i < n && sum >= total / n * i + total % n * i / n)
+	  break ;
+      }
+  twoBitNext = first ;
+  twoBitEnd = k ;
+}
+
+/***** merge shard outputs *****/
+
+static void mergeShards (int n, char **names)
+/* concatenates in order, or block by block if there are ##threshold lines */
+{
+  FILE **fil = (FILE**) malloc (n * sizeof(FILE*)) ;
+  char **line = (char**) calloc (n, sizeof(char*)) ;
+  size_t *size = (size_t*) calloc (n, sizeof(size_t)) ;
+  bool *isMore = (bool*) malloc (n * sizeof(bool)) ;
+  bool isAny ;
+  int i ;
+
+  for (i = 0 ; i < n ; ++i)
+    { if (!(fil[i] = fopen (names[i], "r")))
+	{ fprintf (stderr, "Failed to open shard output %s\n", names[i]) ;
+	  exit (-1) ;
+	}
+      isMore[i] = getline (&line[i], &size[i], fil[i]) > 0 ;
+    }
+
+  do
+    { isAny = false ;
+      for (i = 0 ; i < n ; ++i)
+	{ if (isMore[i] && !strncmp (line[i], "##threshold", 11))
+	    { if (!i) fputs (line[i], stdout) ; /* block header */
+	      isMore[i] = getline (&line[i], &size[i], fil[i]) > 0 ;
+	    }
+	  while (isMore[i] && strncmp (line[i], "##threshold", 11))
+	    { fputs (line[i], stdout) ;
+	      isMore[i] = getline (&line[i], &size[i], fil[i]) > 0 ;
+	    }
+	  if (isMore[i]) isAny = true ;
+	}
+    } while (isAny) ;
+
+  for (i = 0 ; i < n ; ++i)
+    { fclose (fil[i]) ; free (line[i]) ; }
+  free (fil) ; free (line) ; free (size) ; free (isMore) ;
+}
+
+/***** threaded pipeline: reader -> scorers -> writer *****/
+
+/* A ring of slots holds the sequences in flight.  The reader fills slot
+   n % ringSize with the n'th sequence once the writer has freed it, so
+   at most ringSize sequences are held at once, and the writer takes
+   them back in input order.  With -C the shuffles of a sequence are
+   handed out in chunks, so that several scorers can share a long one.
+   The scorer that finishes its last chunk then scores the sequence
+   itself, which reverse complements it in place.
+*/
+
+typedef enum { SLOT_FREE, SLOT_READ, SLOT_SCORING, SLOT_DONE } SlotState ;
+
+typedef struct {
   char *seq ;
-  char c ;
+  long serial ;			/* input order */
+  long nextPos ;		/* input position after this sequence */
+  SegRecord rec ;
+  SlotState state ;
+  int nextShuffle ;		/* first not yet handed out */
+  int shufflesLeft ;		/* not yet scored */
+} Slot ;
+
+static Slot *ring ;
+static int ringSize ;
+static int shuffleChunk ;	/* shuffles handed out at a time */
+static long nRead = 0, nTaken = 0 ;	/* sequences read, taken by scorers */
+static long firstSerial = 0 ;	/* sequences done before a resume */
+static bool isEOF = false ;
+static pthread_mutex_t ringLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t slotFree = PTHREAD_COND_INITIALIZER ;
+static pthread_cond_t slotRead = PTHREAD_COND_INITIALIZER ;
+static pthread_cond_t slotDone = PTHREAD_COND_INITIALIZER ;
+
+static void *readerThread (void *arg)
+{
+  FILE *fil = (FILE*) arg ;
+  Slot *slot ;
+  char *seq, *name ;
   int len ;
-  bool isRC ;
+
+  if (fil) flockfile (fil) ;	/* so the fgetc's in readSequence don't each lock */
+  for (;;)
+    { slot = &ring[nRead % ringSize] ;
+      pthread_mutex_lock (&ringLock) ;
+      while (slot->state != SLOT_FREE)
+	pthread_cond_wait (&slotFree, &ringLock) ;
+      pthread_mutex_unlock (&ringLock) ;
+
+      if (!nextSequence (fil, &seq, &name, &len))
+	break ;
+
+      pthread_mutex_lock (&ringLock) ;
+      slot->seq = seq ;
+      slot->serial = firstSerial + nRead ;
+      slot->nextPos = inputPos (fil) ;
+      slot->rec.name = name ;
+      slot->rec.len = len ;
+      slot->rec.n = 0 ;
+      slot->state = SLOT_READ ;
+      ++nRead ;
+      pthread_cond_signal (&slotRead) ;
+      pthread_mutex_unlock (&ringLock) ;
+    }
+  if (fil) funlockfile (fil) ;
+
+  pthread_mutex_lock (&ringLock) ;
+  isEOF = true ;
+  pthread_cond_broadcast (&slotRead) ;
+  pthread_cond_broadcast (&slotDone) ;
+  pthread_mutex_unlock (&ringLock) ;
+  return 0 ;
+}
+
+static Slot *shuffleWork (int *k0, int *k1)
+/* called with ringLock held: the next chunk of the oldest sequence with
+   shuffles not yet handed out, else 0
+*/
+{
+  long s ;
+  Slot *slot ;
+
+  for (s = nTaken > ringSize ? nTaken - ringSize : 0 ; s < nTaken ; ++s)
+    { slot = &ring[s % ringSize] ;
+      if (slot->state == SLOT_SCORING && slot->nextShuffle < nShuffle)
+	{ *k0 = slot->nextShuffle ;
+	  *k1 = *k0 + shuffleChunk < nShuffle ? *k0 + shuffleChunk : nShuffle ;
+	  slot->nextShuffle = *k1 ;
+	  return slot ;
+	}
+    }
+  return 0 ;
+}
+
+static void *scoreThread (void *arg)
+{
+  Work w ;
+  Slot *slot ;
+  int k0 = 0, k1 = 0 ;
+  bool isLast ;
+
+  memset (&w, 0, sizeof(w)) ;
+  for (;;)
+    { pthread_mutex_lock (&ringLock) ;
+      while (!(slot = shuffleWork (&k0, &k1)) && nTaken == nRead && !isEOF)
+	pthread_cond_wait (&slotRead, &ringLock) ;
+      if (!slot && nTaken < nRead)
+	{ slot = &ring[nTaken++ % ringSize] ;
+	  slot->state = SLOT_SCORING ;
+	  slot->nextShuffle = 0 ;
+	  slot->shufflesLeft = nShuffle ;
+	  if (nShuffle)
+	    { nullSize (&slot->rec) ;
+	      shuffleWork (&k0, &k1) ;
+	      if (slot->nextShuffle < nShuffle) /* more for the others */
+		pthread_cond_broadcast (&slotRead) ;
+	    }
+	}
+      pthread_mutex_unlock (&ringLock) ;
+      if (!slot)
+	break ;
+
+      if (nShuffle)
+	{ shuffleScores (slot->seq, slot->rec.len, slot->serial, k0, k1, &w, slot->rec.null) ;
+	  pthread_mutex_lock (&ringLock) ;
+	  slot->shufflesLeft -= k1 - k0 ;
+	  isLast = !slot->shufflesLeft ;
+	  pthread_mutex_unlock (&ringLock) ;
+	  if (!isLast)
+	    continue ;
+	  slot->rec.nNull = nShuffle ;
+	  qsort (slot->rec.null, nShuffle, sizeof(float), floatOrder) ;
+	}
+      w.thresh = topThreshold () ;
+      scoreCached (slot->seq, slot->rec.len, &w, &slot->rec) ;
+      free (slot->seq) ;
+
+      pthread_mutex_lock (&ringLock) ;
+      slot->state = SLOT_DONE ;
+      pthread_cond_broadcast (&slotDone) ;
+      pthread_mutex_unlock (&ringLock) ;
+    }
+  pthread_mutex_lock (&ringLock) ;
+  workTotals (&w) ;
+  pthread_mutex_unlock (&ringLock) ;
+  workFree (&w) ;
+  return 0 ;
+}
+
+static void runPipeline (FILE *seqFile, int nThreads, int depth)
+/* the calling thread is the writer */
+{
+  int i ;
+  long next ;
+  bool isDone ;
+  Slot *slot ;
+  pthread_t reader, *scorers ;
+
+  ringSize = depth ;
+  shuffleChunk = (nShuffle + 2*nThreads - 1) / (2*nThreads) ;
+  if (shuffleChunk < 1) shuffleChunk = 1 ;
+  ring = (Slot*) calloc (ringSize, sizeof(Slot)) ;
+  scorers = (pthread_t*) malloc (nThreads * sizeof(pthread_t)) ;
+  if (pthread_create (&reader, 0, readerThread, seqFile))
+    { fprintf (stderr, "Failed to start reader thread\n") ; exit (-1) ; }
+  for (i = 0 ; i < nThreads ; ++i)
+    if (pthread_create (&scorers[i], 0, scoreThread, 0))
+      { fprintf (stderr, "Failed to start scoring thread %d\n", i) ; exit (-1) ; }
+
+  for (next = 0 ; ; ++next)
+    { slot = &ring[next % ringSize] ;
+      pthread_mutex_lock (&ringLock) ;
+      while (slot->state != SLOT_DONE && !(isEOF && next == nRead))
+	pthread_cond_wait (&slotDone, &ringLock) ;
+      isDone = (slot->state == SLOT_DONE) ;
+      pthread_mutex_unlock (&ringLock) ;
+      if (!isDone)
+	break ;
+
+      finishRecord (&slot->rec, slot->nextPos) ;
+      free (slot->rec.name) ;
+
+      pthread_mutex_lock (&ringLock) ;
+      slot->state = SLOT_FREE ;
+      pthread_cond_signal (&slotFree) ;
+      pthread_mutex_unlock (&ringLock) ;
+    }
+
+  pthread_join (reader, 0) ;
+  for (i = 0 ; i < nThreads ; ++i)
+    pthread_join (scorers[i], 0) ;
+  for (i = 0 ; i < ringSize ; ++i)
+    { free (ring[i].rec.segs) ; free (ring[i].rec.null) ; }
+  free (ring) ;
+  free (scorers) ;
+}
+
+/****************************************************************/
+
+int main (int argc, char *argv[])
+{
+  FILE *seqFile ;
+  char *storeName = 0, *replayName = 0, *outName = 0, *cacheName = 0 ;
+  long cacheSize = 1024 ;	/* MB */
+  long storeStart = 0 ;
+  int i, nThreads = 0, depth = 0 ;
+  bool isResume = false, isMerge = false ;
+  int shardI = 0, shardN = 0 ;
+  ResumePoint rp ;
 
   --argc ; ++argv ;		/* remove program name */
 
-  while (argc > 2)
-    if (!strcmp (*argv, "-T"))
-      { thresh = atof (argv[1]) ;
+  for (i = 0 ; i < argc ; ++i)	/* the command, to check on resume */
+    if (!strcmp (argv[i], "--resume"))
+      continue ;
+    else if (!strcmp (argv[i], "--every") && i+1 < argc)
+      ++i ;
+    else if (strlen (ckptArgs) + strlen (argv[i]) + 2 < sizeof(ckptArgs))
+      { if (*ckptArgs) strcat (ckptArgs, " ") ;
+	strcat (ckptArgs, argv[i]) ;
+      }
+
+  while (argc && **argv == '-' && (*argv)[1])
+    if (!strcmp (*argv, "-T") && argc > 1)
+      { if (!(nThresh = parseThresholds (argv[1], thresh)))
+	  { fprintf (stderr, "Bad threshold list %s\n", argv[1]) ;
+	    usage() ;
+	  }
 	argc -= 2 ; argv += 2 ;
       }
-    else if (!strcmp (*argv, "-F"))
+    else if (!strcmp (*argv, "-F") && argc > 1)
       { featName = argv[1] ;
 	argc -= 2 ; argv += 2 ;
       }
@@ -180,15 +1257,153 @@ int main (int argc, char *argv[])
       { isTotal = true ;
 	argc -= 1 ; argv += 1 ;
       }
-    else if (**argv == '-')
+    else if (!strcmp (*argv, "-O"))
+      { isCoordOrder = true ;
+	argc -= 1 ; argv += 1 ;
+      }
+    else if (!strcmp (*argv, "-K") && argc > 1)
+      { if ((topK = atoi (argv[1])) <= 0)
+	  { fprintf (stderr, "Bad -K %s, should be a positive number\n", argv[1]) ;
+	    usage() ;
+	  }
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-W") && argc > 1)
+      { storeName = argv[1] ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-R") && argc > 1)
+      { replayName = argv[1] ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-P"))
+      { isPrefilter = true ;
+	argc -= 1 ; argv += 1 ;
+      }
+    else if (!strcmp (*argv, "-C") && argc > 1)
+      { if ((nShuffle = atoi (argv[1])) <= 0)
+	  { fprintf (stderr, "Bad -C %s, should be a positive number\n", argv[1]) ;
+	    usage() ;
+	  }
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-D"))
+      { isDinuc = true ;
+	argc -= 1 ; argv += 1 ;
+      }
+    else if (!strcmp (*argv, "-A") && argc > 1)
+      { fpr = atof (argv[1]) ;
+	if (!(fpr > 0 && fpr < 1))
+	  { fprintf (stderr, "Bad -A %s, should be between 0 and 1\n", argv[1]) ;
+	    usage() ;
+	  }
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-z") && argc > 1)
+      { seed = strtoull (argv[1], 0, 10) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-o") && argc > 1)
+      { outName = argv[1] ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--checkpoint") && argc > 1)
+      { ckptName = argv[1] ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--every") && argc > 1)
+      { ckptEvery = atoi (argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--shard") && argc > 1)
+      { if (sscanf (argv[1], "%d/%d", &shardI, &shardN) != 2 ||
+	    shardI < 1 || shardI > shardN)
+	  { fprintf (stderr, "Bad shard %s, should be i/N with 1 <= i <= N\n", argv[1]) ;
+	    usage() ;
+	  }
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--cache") && argc > 1)
+      { cacheName = argv[1] ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--cache-size") && argc > 1)
+      { cacheSize = atol (argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "--merge"))
+      { isMerge = true ;
+	argc -= 1 ; argv += 1 ;
+	break ;			/* the rest are files */
+      }
+    else if (!strcmp (*argv, "--resume"))
+      { isResume = true ;
+	argc -= 1 ; argv += 1 ;
+      }
+    else if (!strcmp (*argv, "-j") && argc > 1)
+      { nThreads = atoi (argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else if (!strcmp (*argv, "-Q") && argc > 1)
+      { depth = atoi (argv[1]) ;
+	argc -= 2 ; argv += 2 ;
+      }
+    else
       { fprintf (stderr, "Unrecognised option %s\n", *argv) ;
 	usage() ;
       }
-    else
+
+  if (isResume && !ckptName)
+    { fprintf (stderr, "--resume needs --checkpoint\n") ;
       usage() ;
+    }
+  if (outName && !isResume && !freopen (outName, "w", stdout))
+    { fprintf (stderr, "Failed to open output file %s\n", outName) ;
+      exit (-1) ;
+    }
+
+  if (isMerge)
+    { if (!argc)
+	usage() ;
+      mergeShards (argc, argv) ;
+      return 0 ;
+    }
+
+  if (replayName)		/* re-threshold from a segment store */
+    { float floor ;
+      char *storeFeat ;
+
+      if (argc != 0)
+	usage() ;
+      if (!(store = segStoreOpen (replayName, &floor, &frame, &storeFeat)))
+	{ fprintf (stderr, "Failed to open segment store %s\n", replayName) ;
+	  usage() ;
+	}
+      if (!featName) featName = storeFeat ;
+      if (!nThresh)
+	thresh[nThresh++] = floor ;
+      if (thresh[0] < floor)
+	{ fprintf (stderr, "Threshold %g is below the store floor %g\n", thresh[0], floor) ;
+	  exit (-1) ;
+	}
+      reportStore (store, ftell (store), thresh, nThresh) ;
+      fclose (store) ;
+      return 0 ;
+    }
 
   if (argc != 2)
     usage() ;
+  if (!nThresh)
+    thresh[nThresh++] = 0.0 ;
+  floorThresh = thresh[0] ;
+  if (topK)
+    { if (nThresh > 1 || isTotal || isCoordOrder || storeName || nShuffle || ckptName || shardN)
+	{ fprintf (stderr, "-K can't be used with a threshold list, -S, -O, -W, -C, --checkpoint or --shard\n") ;
+	  usage() ;
+	}
+      topHeap = (TopSeg*) malloc (topK * sizeof(TopSeg)) ;
+      topMin = floorThresh ;
+    }
 
   tableName = *argv ; --argc ; ++argv ;
   if (!featName) featName = tableName ;
@@ -196,49 +1411,130 @@ int main (int argc, char *argv[])
     { fprintf (stderr, "Failed to open table file %s\n", tableName) ;
       usage () ;
     }
+  if (cacheName)
+    { if (topK || nShuffle)
+	{ fprintf (stderr, "--cache can't be used with -K or -C\n") ;
+	  usage() ;
+	}
+      if (!(cache = cacheOpen (cacheName, cacheSize << 20)))
+	{ fprintf (stderr, "Failed to open cache directory %s\n", cacheName) ;
+	  exit (-1) ;
+	}
+      makeModeHash () ;
+    }
 
-  if (!strcmp (*argv, "-"))
-    seqFile = stdin ;
-  else if (!(seqFile = fopen (*argv, "r")))
-    { fprintf (stderr, "Failed to open sequence file %s\n", *argv) ;
-      usage() ;
+  seqFile = openSequences (*argv) ;
+  if (shardN)
+    openShard (seqFile, shardI, shardN) ;
+
+  if (ckptName)
+    { if (!outName || seqFile == stdin || (nThresh > 1 && !storeName))
+	{ fprintf (stderr, "--checkpoint needs -o, a seqFile that is not stdin, "
+		   "and -W with a list of thresholds\n") ;
+	  usage() ;
+	}
+      if (nShuffle)		/* calibration scores so far */
+	{ char *nullName = (char*) malloc (strlen (ckptName) + 6) ;
+	  sprintf (nullName, "%s.null", ckptName) ;
+	  if (!(nullFile = fopen (nullName, isResume ? "r+b" : "w+b")))
+	    { fprintf (stderr, "Failed to open calibration score file %s\n", nullName) ;
+	      exit (-1) ;
+	    }
+	  free (nullName) ;
+	}
     }
 
-  long count = 0, sumTotal = 0, sumLength = 0 ;
-  int *conv = dna2indexConv ; conv['n'] = conv['N'] = 1 ; /* map Ns to C for this */
-  while (readSequence (seqFile, conv, &seq, &seqName, 0, &len))
-    { int total = 0 ;
-      partial = (float*) malloc (sizeof(float)*len) ;
-      
-				/* first do forward direction */
-      isRC = false ; strand = '+' ;
-      for (i = 0 ; i < step ; ++i)
-	makePartial (seq+i, len-i, tab, step, partial+i) ;
-      for (i = 0 ; i < step ; ++i)
-	total += processPartial (step, thresh, isRC, i, partial, len) ;
+  if (isResume)
+    { rp = readCheckpoint () ;
+      firstSerial = count ;
+      if (!freopen (outName, "r+", stdout) ||
+	  ftruncate (fileno (stdout), rp.output) || fseek (stdout, rp.output, SEEK_SET))
+	{ fprintf (stderr, "Failed to reopen output file %s at %ld\n", outName, rp.output) ;
+	  exit (-1) ;
+	}
+      if (twoBit)
+	twoBitNext = rp.input ;
+      else if (fseek (seqFile, rp.input, SEEK_SET))
+	{ fprintf (stderr, "Failed to seek sequence file to %ld\n", rp.input) ;
+	  exit (-1) ;
+	}
+      if (storeName && !(store = segStoreReopen (storeName, rp.store, &storeStart)))
+	{ fprintf (stderr, "Failed to reopen segment store %s at %ld\n", storeName, rp.store) ;
+	  exit (-1) ;
+	}
+      if (nullFile)
+	fseek (nullFile, 0, SEEK_END) ;
+    }
+  else if (storeName || nThresh > 1) /* a list of thresholds is reported from a store */
+    { if (!(store = segStoreCreate (storeName, thresh[0], frame, featName)))
+	{ fprintf (stderr, "Failed to create segment store %s\n",
+		   storeName ? storeName : "(temporary)") ;
+	  exit (-1) ;
+	}
+      storeStart = ftell (store) ;
+    }
+  if (ckptName)
+    ckptLast = time (0) ;
 
-				/* then reverse complement */
-      isRC = true ; strand = '-' ;
-      for (i = 0 ; i < len-1-i ; ++i)
-	{ c = 3 - seq[i] ;	/* NB "3 -" does complement */
-	  seq[i] = 3 - seq[len-1-i] ; 
-	  seq[len-1-i] = c ; 
-	}
-      for (i = 0 ; i < step ; ++i)
-	makePartial (seq+i, len-i, tab, step, partial+i) ;
-      for (i = 0 ; i < step ; ++i)
-	total += processPartial (step, thresh, isRC, i, partial, len) ;
-
-      if (isTotal) printf ("%s\t%d\t%d\n", seqName, len, total) ;
-      sumTotal += total ;
-      sumLength += len ;
-      ++count ;
-      free (seq) ;
-      free (seqName) ;
-      free (partial) ;
-   }
-
-  fprintf (stderr, "%ld sequences %ld sumLength %ld sumTotal\n", count, sumLength, sumTotal) ;
+  dna2indexConv['n'] = dna2indexConv['N'] = 1 ; /* map Ns to C for this */
+  if (nShuffle > 0 && !nThreads)	/* calibration uses all cores by default */
+    nThreads = sysconf (_SC_NPROCESSORS_ONLN) ;
+  if (nThreads > 0)
+    runPipeline (seqFile, nThreads, depth > 0 ? depth : 4*nThreads) ;
+  else
+    { char *seq ;
+      SegRecord rec ;
+      Work w ;
+
+      memset (&rec, 0, sizeof(rec)) ;
+      memset (&w, 0, sizeof(w)) ;
+      while (nextSequence (seqFile, &seq, &rec.name, &rec.len))
+	{ rec.n = 0 ;
+	  if (nShuffle)
+	    calibrateSequence (seq, rec.len, count, &w, &rec) ;
+	  w.thresh = topThreshold () ;
+	  scoreCached (seq, rec.len, &w, &rec) ;
+	  finishRecord (&rec, inputPos (seqFile)) ;
+	  free (seq) ;
+	  free (rec.name) ;
+	}
+      workTotals (&w) ;
+      workFree (&w) ;
+      free (rec.segs) ;
+      free (rec.null) ;
+    }
+
+  if (ckptName)			/* scan complete, only the reports remain */
+    checkpoint (inputPos (seqFile)) ;
+
+  reportCalibration () ;
+  if (cache)
+    { long hits, misses ;
+      cacheClose (cache, &hits, &misses) ;
+      fprintf (stderr, "cache: %ld hits %ld misses\n", hits, misses) ;
+    }
+  if (isPrefilter)
+    fprintf (stderr, "prefilter pruned %ld of %ld positions (%.1f%%)\n", prefilterPruned,
+	     prefilterPos, prefilterPos ? 100.0 * prefilterPruned / prefilterPos : 0.0) ;
+  if (topK)
+    sumTotal = reportTop () ;
+  if (nThresh == 1)
+    fprintf (stderr, "%ld sequences %ld sumLength %ld sumTotal\n", count, sumLength, sumTotal) ;
+  else
+    reportStore (store, storeStart, thresh, nThresh) ;
+  if (store) fclose (store) ;
+  twoBitClose (twoBit) ;
+  if (ckptName)			/* finished, so the checkpoint is stale */
+    { unlink (ckptName) ;
+      if (nullFile)
+	{ char *nullName = (char*) malloc (strlen (ckptName) + 6) ;
+	  sprintf (nullName, "%s.null", ckptName) ;
+	  fclose (nullFile) ;
+	  unlink (nullName) ;
+	  free (nullName) ;
+	}
+    }
+  return 0 ;
 }
 
 /**************** end of file ****************/
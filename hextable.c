@@ -15,11 +15,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "readseq.h"
+#include "twobit.h"
+#include "gffcds.h"
 #include <stdarg.h>
 #include <math.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
 
 int   nHex, hex[4096] ;
 int   nHex2, hex2[4096] ;
@@ -45,11 +50,20 @@ void die (char *format, ...)
       va_end (args) ;
     }
   fprintf (stderr, "Usage: hextable [-o ofile] [-2 file2] [-s sfile] file1\n") ;
+  fprintf (stderr, "       hextable --shard i/N -o countFile [-2 file2] file1\n") ;
+  fprintf (stderr, "       hextable --merge [-o ofile] [-s sfile] countFile ...\n") ;
+  fprintf (stderr, "       hextable -g gffFile [-b] [-j threads] [-o ofile] [-s sfile] genome\n") ;
   fprintf (stderr, "  all files are DNA fasta files\n") ;
   fprintf (stderr, "  -o <file>  output file\n") ;
   fprintf (stderr, "  -2 <file2> calculate stats by LLratio to file2\n") ;
   fprintf (stderr, "  -s <sfile> evaluates stats on sfile, not file1\n") ;
   fprintf (stdout, "  -n         flag for noncoding (no triplet frame)\n") ;
+  fprintf (stderr, "  --shard i/N  count only shard i of N (from 1) of file1 and file2,\n") ;
+  fprintf (stderr, "               writing counts to the -o file\n") ;
+  fprintf (stderr, "  --merge      sum shard counts and make the table from them\n") ;
+  fprintf (stderr, "  -g <gff>   count CDS of GFF3/GTF transcripts spliced from genome, fasta or .2bit\n") ;
+  fprintf (stderr, "  -b         with -g, count the genome outside CDS as the -2 background\n") ;
+  fprintf (stderr, "  -j <n>     with -g, threads   all cores\n") ;
 
   exit (-1) ;
 }
@@ -243,75 +257,347 @@ void scoreSeqs (void)
     printf ("  %3d :  %d\n", (i-100)*10, sHist[i]) ;
 }
 
+/********** counting, optionally of one shard of a file **********/
+
+#define N_CODE 4		/* -g: N and other ambiguity codes */
+
+static int codonIndex (char *s)	/* -1 if any base is not a c g t */
+{
+  if ((s[0] | s[1] | s[2]) & ~3) return -1 ;
+  return (s[0] << 4) + (s[1] << 2) + s[2] ;
+}
+
+void countSeq (char *s, int len, int *h, int *nH, int *cod)
+/* hexamers in frame from s[0], and the codons that start them if cod;
+   codons and hexamers containing other codes are skipped
+*/
+{
+  int i, last, next ;
+
+  if (len < 6) return ;
+  last = codonIndex (s) ; s += 3 ;
+  for (i = 3 ; i < len-3 ; i += 3, s += 3)
+    { next = codonIndex (s) ;
+      if (last >= 0)
+	{ if (cod) ++cod[last] ;
+	  if (next >= 0)
+	    { ++h[(last << 6) + next] ;
+	      ++*nH ;
+	    }
+	}
+      last = next ;
+    }
+}
+
+void countFile (FILE *fil, long end, int *h, int *nH, int *cod, int isKeep)
+/* stops at offset end if end >= 0; isKeep saves the sequences for scoreSeqs */
+{
+  char *seq, *id ;
+  int len ;
+
+  while ((end < 0 || ftell (fil) < end) &&
+	 readSequence (fil, dna2indexConv, &seq, &id, 0, &len))
+    { if (isKeep)
+	{ seqs[nseq] = seq ; ids[nseq] = id ; lens[nseq] = len ; 
+	  if (++nseq > 1000)
+	    die ("More than 1000 sequences - edit and recompile") ;
+	}
+      countSeq (seq, len, h, nH, cod) ;
+      if (!isKeep)
+	{ free (seq) ; free (id) ; }
+    }
+}
+
+FILE *openShard (char *name, int shardI, int shardN, long *end)
+{
+  FILE *fil ;
+  long start ;
+
+  if (!(fil = fopen (name, "r")))
+    die ("Failed to open fasta file %s", name) ;
+  *end = -1 ;
+  if (shardN && !seqShard (fil, shardI, shardN, &start, end))
+    die ("Can't make shard %d/%d of %s", shardI, shardN, name) ;
+  return fil ;
+}
+
+/* A count file holds the counts without the Dirichlet prior:
+     hextable counts
+     nHex nHex2			nHex2 is -1 if there was no file2
+     4096 hex counts, 64 codon counts, and 4096 hex2 counts if nHex2 >= 0
+*/
+
+void writeCounts (char *name, int isLR)
+{
+  FILE *fil ;
+  int i ;
+
+  if (!(fil = fopen (name, "w")))
+    die ("Can't open count file %s", name) ;
+  fprintf (fil, "hextable counts\n%d %d\n", nHex - 4096, isLR ? nHex2 - 4096 : -1) ;
+  for (i = 0 ; i < 4096 ; ++i)
+    fprintf (fil, "%d%c", hex[i] - 1, (i % 16 == 15) ? '\n' : ' ') ;
+  for (i = 0 ; i < 64 ; ++i)
+    fprintf (fil, "%d%c", codon[i], (i % 16 == 15) ? '\n' : ' ') ;
+  if (isLR)
+    for (i = 0 ; i < 4096 ; ++i)
+      fprintf (fil, "%d%c", hex2[i] - 1, (i % 16 == 15) ? '\n' : ' ') ;
+  if (fclose (fil))
+    die ("Failed writing count file %s", name) ;
+}
+
+int addCounts (char *name)	/* returns whether there were file2 counts */
+{
+  FILE *fil ;
+  int i, n, n2, x ;
+
+  if (!(fil = fopen (name, "r")))
+    die ("Failed to open count file %s", name) ;
+  if (fscanf (fil, "hextable counts %d %d", &n, &n2) != 2)
+    die ("%s is not a hextable count file", name) ;
+  nHex += n ;
+  for (i = 0 ; i < 4096 ; ++i)
+    if (fscanf (fil, "%d", &x) == 1) hex[i] += x ;
+    else die ("Truncated count file %s", name) ;
+  for (i = 0 ; i < 64 ; ++i)
+    if (fscanf (fil, "%d", &x) == 1) codon[i] += x ;
+    else die ("Truncated count file %s", name) ;
+  if (n2 >= 0)
+    { nHex2 += n2 ;
+      for (i = 0 ; i < 4096 ; ++i)
+	if (fscanf (fil, "%d", &x) == 1) hex2[i] += x ;
+	else die ("Truncated count file %s", name) ;
+    }
+  fclose (fil) ;
+  return (n2 >= 0) ;
+}
+
+/********** counting CDS spliced from a genome **********/
+
+/* The genome is read one sequence at a time.  The transcripts on it are
+   shared out between threads, each splicing into its own buffer and
+   counting into its own Counts, which are added up at the end, so the
+   table is the same whatever the number of threads.  Meanwhile the main
+   thread counts the stretches outside all CDS into hex2 if asked.
+*/
+
+typedef struct {
+  int hex[4096], codon[64] ;
+  int nHex ;
+  int nTx, nBad ;		/* transcripts counted, off the end */
+} Counts ;
+
+static Cds *cds ;
+static int nCds ;
+static char *chromSeq ;		/* the current genome sequence */
+static int chromLen ;
+static int *txStart, nTx, nextTx ; /* transcripts on it, the next to count */
+static pthread_mutex_t txLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static void *countTranscripts (void *arg)
+{
+  Counts *c = (Counts*) arg ;
+  char *buf = 0, *start ;
+  int t, n, bufSize = 0 ;
+
+  for (;;)
+    { pthread_mutex_lock (&txLock) ;
+      t = nextTx++ ;
+      pthread_mutex_unlock (&txLock) ;
+      if (t >= nTx) break ;
+      n = gffSplice (cds, txStart[t], gffTranscriptEnd (cds, nCds, txStart[t]),
+		     chromSeq, chromLen, &buf, &bufSize, &start) ;
+      if (n < 0)
+	++c->nBad ;
+      else
+	{ countSeq (start, n, c->hex, &c->nHex, c->codon) ;
+	  ++c->nTx ;
+	}
+    }
+  free (buf) ;
+  return 0 ;
+}
+
+static void countBackground (int i, int j)	/* outside cds[i..j) */
+{
+  int k, x ;
+  char *isCds = (char*) calloc (chromLen, 1) ;
+
+  for (k = i ; k < j ; ++k)
+    if (cds[k].end <= chromLen)
+      memset (isCds + cds[k].start - 1, 1, cds[k].end - cds[k].start + 1) ;
+  for (x = 0 ; x < chromLen ; x = k)
+    { for (k = x ; k < chromLen && !isCds[k] ; ++k)
+	;
+      countSeq (chromSeq + x, k - x, hex2, &nHex2, 0) ;
+      for ( ; k < chromLen && isCds[k] ; ++k) ;
+    }
+  free (isCds) ;
+}
+
+void countGenome (char *genome, char *gff, int nThreads, int isBackground)
+{
+  FILE *fil = 0 ;
+  TwoBit *tb ;
+  char *name ;
+  int i, j, k, t, nSeq = 0, nUsed = 0 ;
+  Counts *counts ;
+  pthread_t *threads ;
+
+  if (!(cds = gffReadCds (gff, &nCds)))
+    die ("Failed to open GFF file %s", gff) ;
+  if (!(tb = twoBitOpen (genome)) && !(fil = fopen (genome, "r")))
+    die ("Failed to open genome file %s", genome) ;
+  counts = (Counts*) calloc (nThreads, sizeof(Counts)) ;
+  threads = (pthread_t*) malloc (nThreads * sizeof(pthread_t)) ;
+  txStart = (int*) malloc (nCds * sizeof(int)) ;
+
+  for (;;)
+    { if (tb)
+	{ if (nSeq == twoBitCount (tb)) break ;
+	  name = strdup (twoBitName (tb, nSeq)) ;
+	  if (twoBitRead (tb, nSeq, dna2indexConv['n'], &chromSeq, &chromLen) < 0)
+	    die ("Corrupt .2bit record %s", name) ;
+	}
+      else if (!readSequence (fil, dna2indexConv, &chromSeq, &name, 0, &chromLen))
+	{ if (feof (fil)) break ;
+	  die ("Failed to read sequence %d of genome file %s", nSeq+1, genome) ;
+	}
+      ++nSeq ;
+
+      if ((i = gffFindSeq (cds, nCds, name)) >= 0)
+	{ for (j = i, nTx = 0 ; j < nCds && !strcmp (cds[j].seqName, name) ;
+	       j = gffTranscriptEnd (cds, nCds, j))
+	    txStart[nTx++] = j ;
+	  nUsed += j - i ;
+	  nextTx = 0 ;
+	  for (t = 0 ; t < nThreads ; ++t)
+	    if (pthread_create (&threads[t], 0, countTranscripts, &counts[t]))
+	      die ("Failed to start counting thread %d", t) ;
+	}
+      else
+	j = i ;
+      if (isBackground)
+	countBackground (i, j) ;
+      if (i >= 0)
+	for (t = 0 ; t < nThreads ; ++t)
+	  pthread_join (threads[t], 0) ;
+      free (chromSeq) ;
+      free (name) ;
+    }
+
+  for (t = 0, i = 0, j = 0 ; t < nThreads ; ++t)
+    { for (k = 0 ; k < 4096 ; ++k) hex[k] += counts[t].hex[k] ;
+      for (k = 0 ; k < 64 ; ++k) codon[k] += counts[t].codon[k] ;
+      nHex += counts[t].nHex ;
+      i += counts[t].nTx ; j += counts[t].nBad ;
+    }
+  fprintf (stderr, "%d transcripts counted, %d running off their sequence, "
+	   "%d of %d CDS on sequences not in %s\n", i, j, nCds - nUsed, nCds, genome) ;
+
+  if (fil) fclose (fil) ;
+  twoBitClose (tb) ;
+  free (counts) ; free (threads) ; free (txStart) ;
+  for (k = 0 ; k < nCds ; ++k)
+    { free (cds[k].seqName) ; free (cds[k].txName) ; }
+  free (cds) ;
+}
+
+/****************************************************************/
+
 int main (int argc, char **argv)
 { 
   FILE *fil ;
-  char *seq, *id, *s ;
-  char *file1, *ofile = 0, *sfile = 0, *file2 = 0 ;
-  int i, n, len, index ;
-
-  while ((n = getopt (argc, argv, "o:s:2:n")) != -1)
+  char *seq, *id ;
+  char *file1, *ofile = 0, *sfile = 0, *file2 = 0, *gffFile = 0 ;
+  int i, n, len, nThreads = 0, isBackground = 0 ;
+  int shardI = 0, shardN = 0, isMerge = 0, isLR ;
+  long end ;
+  static struct option longOpts[] = {
+    { "shard", required_argument, 0, 'S' },
+    { "merge", no_argument, 0, 'M' },
+    { 0, 0, 0, 0 }
+  } ;
+
+  while ((n = getopt_long (argc, argv, "o:s:2:ng:bj:", longOpts, 0)) != -1)
     switch (n)
       {
       case 'o': ofile = optarg ; break ;
       case 's': sfile = optarg ; break ;
       case '2': file2 = optarg ; break ;
       case 'n': isCoding = 0 ; break ;
+      case 'g': gffFile = optarg ; break ;
+      case 'b': isBackground = 1 ; break ;
+      case 'j': nThreads = atoi (optarg) ; break ;
+      case 'S':
+	if (sscanf (optarg, "%d/%d", &shardI, &shardN) != 2 || shardI < 1 || shardI > shardN)
+	  die ("Bad shard %s, should be i/N with 1 <= i <= N", optarg) ;
+	break ;
+      case 'M': isMerge = 1 ; break ;
       default: die ("usage") ;
       }
-  if (argc - optind != 1)
+  if (isMerge ? (argc == optind || shardN || file2) : argc - optind != 1)
     die ("usage") ;
-  file1 = argv[optind] ;
+  if (shardN && !ofile)
+    die ("--shard needs -o for the count file") ;
+  if ((gffFile || isBackground) && (isMerge || shardN))
+    die ("-g can't be used with --shard or --merge") ;
+  if (isBackground && !gffFile)
+    die ("-b needs -g") ;
+  if (nThreads <= 0)
+    nThreads = sysconf (_SC_NPROCESSORS_ONLN) ;
 
   dna2indexConv['n'] = dna2indexConv['N'] = -2 ;
-
-  if (!(fil = fopen (file1, "r")))
-    die ("Failed to open fasta file %s", file1) ;
+  if (gffFile)			/* genomes have Ns, which are skipped */
+    for (i = 'A' ; i <= 'Z' ; ++i)
+      if (dna2indexConv[i] < -1 || i == 'N')
+	dna2indexConv[i] = dna2indexConv[i + 'a' - 'A'] = N_CODE ;
 
 				/* Dirichlet prior */
   for (i = 0 ; i < 4096 ; ++i)
     hex[i] = 1 ;
   nHex = 4096 ;
 
-  while (readSequence (fil, dna2indexConv, &seq, &id, 0, &len))
-    { s = seq ;
-      seqs[nseq] = seq ; ids[nseq] = id ; lens[nseq] = len ; 
-      if (++nseq > 1000)
-	die ("More than 1000 sequences - edit and recompile") ;
-      index = (s[0] << 4) + (s[1] << 2) + s[2] ; s += 3 ;
-      for (i = 3 ; i < len-3 ; i += 3, s += 3)
-	{ index &= 0x3f ;
-	  ++codon[index] ;
-	  index <<= 6 ;
-	  index += (s[0] << 4) + (s[1] << 2) + s[2] ;
-	  ++hex[index] ;
-	  ++nHex ;
-	}
+  if (isMerge)
+    { isLR = addCounts (argv[optind]) ;
+      for (i = optind+1 ; i < argc ; ++i)
+	if (addCounts (argv[i]) != isLR)
+	  die ("Count file %s differs from %s in having -2 counts", argv[i], argv[optind]) ;
     }
-  fclose (fil) ;
-
-  information (3, codon) ;
-  information (6, hex) ;
+  else
+    isLR = (file2 || isBackground) ;
 
-  if (file2)
+  if (isLR)
     { for (i = 0 ; i < 4096 ; ++i)
-	hex2[i] = 1 ;
-      nHex2 = 4096 ;
-
-      while (readSequence (fil, dna2indexConv, &seq, &id, 0, &len))
-	{ s = seq ;
-	  index = (s[0] << 4) + (s[1] << 2) + s[2] ; s += 3 ;
-	  for (i = 3 ; i < len-3 ; i += 3, s += 3)
-	    { index &= 0x3f ;
-	      index <<= 6 ;
-	      index += (s[0] << 4) + (s[1] << 2) + s[2] ;
-	      ++hex2[index] ;
-	      ++nHex2 ;
-	    }
+	hex2[i] += 1 ;
+      nHex2 += 4096 ;
+    }
+  if (!isMerge)
+    { file1 = argv[optind] ;
+      if (gffFile)
+	countGenome (file1, gffFile, nThreads, isBackground) ;
+      else
+	{ fil = openShard (file1, shardI, shardN, &end) ;
+	  countFile (fil, end, hex, &nHex, codon, !shardN) ;
+	  fclose (fil) ;
 	}
+    }
+  if (file2)
+    { fil = openShard (file2, shardI, shardN, &end) ;
+      countFile (fil, end, hex2, &nHex2, 0, 0) ;
       fclose (fil) ;
-      hexLikelihoodRatio () ;
     }
+
+  if (shardN)
+    { writeCounts (ofile, isLR) ;
+      return 0 ;
+    }
+
+  information (3, codon) ;
+  information (6, hex) ;
+
+  if (isLR)
+    hexLikelihoodRatio () ;
   else
     hexTableComposition () ;
 
@@ -329,7 +615,8 @@ int main (int argc, char **argv)
 	}
     }
 
-  scoreSeqs () ;
+  if (nseq || !(isMerge || gffFile))
+    scoreSeqs () ;
   return 0 ;
 }
 
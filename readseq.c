@@ -8,7 +8,7 @@
 		conv[x] is the internal code for char 'x'
 		conv[x] == -1 means ignore. conv[x] < -1 means error.
 		will work on fil == stdin
- * Exported functions: readSequence, writeSequence, seqConvert
+ * Exported functions: readSequence, writeSequence, seqConvert, seqShard
  * HISTORY:
  * Last edited: Aug  2 23:51 2021 (rd109)
  * * Dec 29 23:35 1993 (rd): now works off FILE*, returns id and desc
@@ -142,6 +142,35 @@ int readSequence (FILE *fil, int *conv,
 
 /*****************************************************/
 
+static long recordStart (FILE *fil, long pos, long size)
+/* first '>' at the start of a line at or after pos */
+{
+  int c, last ;
+
+  if (pos <= 0) return 0 ;
+  if (pos >= size) return size ;
+  if (fseek (fil, pos-1, SEEK_SET)) return -1 ;
+  for (last = fgetc (fil) ; (c = fgetc (fil)) != EOF ; last = c)
+    if (c == '>' && last == '\n')
+      return ftell (fil) - 1 ;
+  return size ;
+}
+
+int seqShard (FILE *fil, int i, int n, long *start, long *end)
+{
+  long size ;
+
+  if (i < 1 || i > n || fseek (fil, 0, SEEK_END) || (size = ftell (fil)) < 0)
+    return 0 ;
+  *start = recordStart (fil, size / n * (i-1) + size % n * (i-1) / n, size) ;
+  *end = recordStart (fil, size / n * i + size % n * i / n, size) ;
+  if (*start < 0 || *end < 0 || fseek (fil, *start, SEEK_SET))
+    return 0 ;
+  return 1 ;
+}
+
+/*****************************************************/
+
 int seqConvert (char *seq, int *length, int *conv)
 {
   int i, n = 0 ;
@@ -17,6 +17,9 @@ extern int readSequence (FILE *fil, int *conv,
 extern int writeSequence (FILE *fil, int *conv, 
 			  char *seq, char *id, char *desc, int len) ;
 				/* write sequence to file, using convert */
+extern int seqShard (FILE *fil, int i, int n, long *start, long *end) ;
+				/* byte range of shard i of n (1..n), snapped to
+				   record starts; fil must be seekable */
 extern int seqConvert (char *seq, int *length, int *conv) ;
 				/* convert in place - can shorten */
 extern int readMatrix (char *name, int *conv, int** *mat) ;
@@ -0,0 +1,185 @@
+/*  File: segstore.c
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: segment lists and the binary segment store
+		The store holds every maximal segment scoring above a floor
+		threshold.  Since the set of maximal segments does not depend
+		on the threshold, the segments for any T >= floor are exactly
+		those in the store with score > T.
+		File layout, in native byte order:
+		  "HEXSEG2\n" float floor, char frame, int n, n chars featName
+		  then per sequence
+		  int n, n chars name, int len, int nSeg,
+		  nSeg * (int x1, int x2, float score, char strand),
+		  int nNull, nNull * float null
+ * Exported functions: see segstore.h
+ * HISTORY:
+ * Created: Sun Oct 18 09:56:20 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>		/* for ftruncate */
+#include "segstore.h"
+
+static char magic[] = "HEXSEG2\n" ;
+
+void segAdd (SegRecord *r, int x1, int x2, float score, char strand)
+{
+  if (r->n == r->max)
+    { r->max = r->max ? 2*r->max : 64 ;
+      r->segs = (Seg*) realloc (r->segs, r->max * sizeof(Seg)) ;
+      if (!r->segs)
+	{ fprintf (stderr, "MALLOC failure for %d segments - aborting\n", r->max) ;
+	  exit (-1) ;
+	}
+    }
+  r->segs[r->n].x1 = x1 ;
+  r->segs[r->n].x2 = x2 ;
+  r->segs[r->n].score = score ;
+  r->segs[r->n].strand = strand ;
+  ++r->n ;
+}
+
+/*****************************************************/
+
+static bool writeString (FILE *fil, char *s)
+{
+  int n = strlen (s) ;
+
+  return fwrite (&n, sizeof(int), 1, fil) == 1 && fwrite (s, 1, n, fil) == n ;
+}
+
+static bool readString (FILE *fil, char **s)	/* reuses *s */
+{
+  int n ;
+  char *t ;
+
+  if (fread (&n, sizeof(int), 1, fil) != 1 || n < 0) return false ;
+  if (!(t = (char*) realloc (*s, n+1))) return false ;
+  *s = t ;
+  if (fread (t, 1, n, fil) != n) return false ;
+  t[n] = 0 ;
+  return true ;
+}
+
+FILE *segStoreCreate (char *name, float floor, char frame, char *featName)
+{
+  FILE *fil ;
+
+  if (!(fil = name ? fopen (name, "w+b") : tmpfile ())) return 0 ;
+
+  if (fwrite (magic, 1, 8, fil) != 8 ||
+      fwrite (&floor, sizeof(float), 1, fil) != 1 ||
+      fwrite (&frame, 1, 1, fil) != 1 ||
+      !writeString (fil, featName))
+    { fclose (fil) ; return 0 ; }
+
+  return fil ;
+}
+
+bool segStoreWrite (FILE *fil, SegRecord *r)
+{
+  int i ;
+  Seg *s ;
+
+  if (!writeString (fil, r->name) ||
+      fwrite (&r->len, sizeof(int), 1, fil) != 1 ||
+      fwrite (&r->n, sizeof(int), 1, fil) != 1)
+    return false ;
+  for (i = 0, s = r->segs ; i < r->n ; ++i, ++s)
+    if (fwrite (&s->x1, sizeof(int), 1, fil) != 1 ||
+	fwrite (&s->x2, sizeof(int), 1, fil) != 1 ||
+	fwrite (&s->score, sizeof(float), 1, fil) != 1 ||
+	fwrite (&s->strand, 1, 1, fil) != 1)
+      return false ;
+  if (fwrite (&r->nNull, sizeof(int), 1, fil) != 1 ||
+      fwrite (r->null, sizeof(float), r->nNull, fil) != r->nNull)
+    return false ;
+
+  return true ;
+}
+
+FILE *segStoreReopen (char *name, long pos, long *start)
+{
+  FILE *fil ;
+  float floor ;
+  char frame, *featName = 0 ;
+
+  if (!(fil = segStoreOpen (name, &floor, &frame, &featName))) return 0 ;
+  *start = ftell (fil) ;
+  free (featName) ;
+  fclose (fil) ;
+
+  if (pos < *start || !(fil = fopen (name, "r+b"))) return 0 ;
+  if (ftruncate (fileno (fil), pos) || fseek (fil, pos, SEEK_SET))
+    { fclose (fil) ; return 0 ; }
+  return fil ;
+}
+
+FILE *segStoreOpen (char *name, float *floor, char *frame, char **featName)
+{
+  FILE *fil ;
+  char buf[8] ;
+
+  *featName = 0 ;
+  if (!(fil = fopen (name, "rb"))) return 0 ;
+
+  if (fread (buf, 1, 8, fil) != 8 || memcmp (buf, magic, 8))
+    { fprintf (stderr, "%s is not a hexamer segment store\n", name) ;
+      fclose (fil) ; return 0 ;
+    }
+  if (fread (floor, sizeof(float), 1, fil) != 1 ||
+      fread (frame, 1, 1, fil) != 1 ||
+      !readString (fil, featName))
+    { fprintf (stderr, "truncated header in segment store %s\n", name) ;
+      fclose (fil) ; return 0 ;
+    }
+
+  return fil ;
+}
+
+int segStoreRead (FILE *fil, SegRecord *r)
+{
+  int i, n ;
+  Seg *s ;
+
+  if ((i = getc (fil)) == EOF) return 0 ; /* clean end between records */
+  ungetc (i, fil) ;
+
+  if (!readString (fil, &r->name)) return -1 ;
+  if (fread (&r->len, sizeof(int), 1, fil) != 1 ||
+      fread (&n, sizeof(int), 1, fil) != 1 || n < 0)
+    return -1 ;
+
+  r->n = 0 ;
+  if (n > r->max)
+    { r->max = n ;
+      if (!(r->segs = (Seg*) realloc (r->segs, n * sizeof(Seg)))) return -1 ;
+    }
+  for (i = 0, s = r->segs ; i < n ; ++i, ++s)
+    if (fread (&s->x1, sizeof(int), 1, fil) != 1 ||
+	fread (&s->x2, sizeof(int), 1, fil) != 1 ||
+	fread (&s->score, sizeof(float), 1, fil) != 1 ||
+	fread (&s->strand, 1, 1, fil) != 1)
+      return -1 ;
+  r->n = n ;
+
+  r->nNull = 0 ;
+  if (fread (&n, sizeof(int), 1, fil) != 1 || n < 0) return -1 ;
+  if (n > r->maxNull)
+    { r->maxNull = n ;
+      if (!(r->null = (float*) realloc (r->null, n * sizeof(float)))) return -1 ;
+    }
+  if (fread (r->null, sizeof(float), n, fil) != n) return -1 ;
+  r->nNull = n ;
+
+  return 1 ;
+}
+
+/**************** end of file ***************/
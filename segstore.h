@@ -0,0 +1,47 @@
+/*  File: segstore.h
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: per-sequence lists of maximal segments, and a compact
+                binary store of them so that hexamer can re-threshold
+		without rescanning the sequence
+ * Exported functions: segAdd, segStoreCreate, segStoreWrite, segStoreReopen,
+                       segStoreOpen, segStoreRead
+ * HISTORY:
+ * Created: Sun Oct 18 09:56:20 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+typedef struct {
+  int x1, x2 ;			/* 0-based, forward strand coords, x1 <= x2 */
+  float score ;
+  char strand ;			/* '+' or '-' */
+} Seg ;
+
+typedef struct {
+  char *name ;
+  int len ;
+  int n, max ;			/* number used, number allocated */
+  Seg *segs ;
+  float *null ;			/* sorted best scores in shuffles */
+  int nNull, maxNull ;
+} SegRecord ;
+
+extern void segAdd (SegRecord *r, int x1, int x2, float score, char strand) ;
+				/* append, growing r->segs as needed */
+
+extern FILE *segStoreCreate (char *name, float floor, char frame, char *featName) ;
+				/* name == 0 gives an anonymous temporary file */
+extern bool segStoreWrite (FILE *fil, SegRecord *r) ;
+extern FILE *segStoreReopen (char *name, long pos, long *start) ;
+				/* for appending from pos, discarding what follows;
+				   *start is the position of the first record */
+extern FILE *segStoreOpen (char *name, float *floor, char *frame, char **featName) ;
+				/* leaves fil positioned at the first record */
+extern int segStoreRead (FILE *fil, SegRecord *r) ;
+				/* 1 for a record, 0 at the end of the file,
+				   -1 for a truncated or bad record;
+				   reuses r->name, r->segs and r->null space */
+
+/***** end of file *****/
@@ -0,0 +1,111 @@
+/*  File: shuffle.c
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: seeded composition preserving shuffles of index coded DNA
+		The generator is splitmix64, so that each shuffle can have
+		its own state, independent of threading and order.
+		The dinucleotide shuffle is the Altschul-Erickson method as
+		done by Kandel et al. 1996: treat the sequence as an Eulerian
+		path through the 4 bases, choose random last exits from each
+		base forming a tree into the final base, permute the other
+		exits, and walk.
+ * Exported functions: see shuffle.h
+ * HISTORY:
+ * Created: Sun Oct 18 10:06:34 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "shuffle.h"
+
+static uint64_t next (uint64_t *x)	/* splitmix64 */
+{
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL) ;
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL ;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL ;
+  return z ^ (z >> 31) ;
+}
+
+static int pick (uint64_t *x, int n)	/* uniform in 0..n-1 */
+{
+  return (int) (((next (x) >> 32) * (uint64_t) n) >> 32) ;
+}
+
+uint64_t shuffleSeed (uint64_t seed, long a, long b)
+{
+  uint64_t x = seed ;
+
+  x = next (&x) ^ (uint64_t) a ;
+  x = next (&x) ^ (uint64_t) b ;
+  return next (&x) ;
+}
+
+void shuffleCodons (char *s, int len, uint64_t *rng)
+{
+  int i, j ;
+  char c[3] ;
+
+  for (i = len/3 ; i > 1 ; --i)
+    { j = pick (rng, i) ;
+      if (j == i-1) continue ;
+      memcpy (c, s + 3*(i-1), 3) ;
+      memcpy (s + 3*(i-1), s + 3*j, 3) ;
+      memcpy (s + 3*j, c, 3) ;
+    }
+}
+
+void shuffleDinucleotides (char *s, int len, uint64_t *rng)
+{
+  int i, j, v, k, last ;
+  int count[4], start[4], pos[4], lastExit[4] ;
+  char t, *edges ;
+
+  if (len < 3) return ;
+  last = s[len-1] ;
+
+  memset (count, 0, sizeof(count)) ;
+  for (i = 0 ; i < len-1 ; ++i) ++count[(int)s[i]] ;
+  for (v = 0, k = 0 ; v < 4 ; ++v) { start[v] = pos[v] = k ; k += count[v] ; }
+  edges = (char*) malloc (len) ;
+  for (i = 0 ; i < len-1 ; ++i) edges[pos[(int)s[i]]++] = s[i+1] ;
+
+  for (;;)			/* last exits must form a tree into last */
+    { for (v = 0 ; v < 4 ; ++v)
+	if (v != last && count[v])
+	  lastExit[v] = pick (rng, count[v]) ;
+      for (v = 0 ; v < 4 ; ++v)
+	if (v != last && count[v])
+	  { for (i = v, k = 0 ; i != last && k < 4 ; ++k)
+	      i = edges[start[i] + lastExit[i]] ;
+	    if (i != last) break ;
+	  }
+      if (v == 4) break ;
+    }
+
+  for (v = 0 ; v < 4 ; ++v)
+    { char *e = edges + start[v] ;
+      int n = count[v] ;
+      if (v != last && n)	/* move last exit to the end, permute the rest */
+	{ t = e[lastExit[v]] ; e[lastExit[v]] = e[n-1] ; e[n-1] = t ;
+	  --n ;
+	}
+      for (i = n ; i > 1 ; --i)
+	{ j = pick (rng, i) ;
+	  t = e[i-1] ; e[i-1] = e[j] ; e[j] = t ;
+	}
+      pos[v] = start[v] ;
+    }
+
+  for (i = 1, v = s[0] ; i < len ; ++i)
+    v = s[i] = edges[pos[v]++] ;
+
+  free (edges) ;
+}
+
+/**************** end of file ***************/
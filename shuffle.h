@@ -0,0 +1,21 @@
+/*  File: shuffle.h
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: seeded composition preserving shuffles of index coded DNA
+ * Exported functions: shuffleSeed, shuffleCodons, shuffleDinucleotides
+ * HISTORY:
+ * Created: Sun Oct 18 10:06:34 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+extern uint64_t shuffleSeed (uint64_t seed, long a, long b) ;
+				/* independent rng state for each (a, b) */
+extern void shuffleCodons (char *s, int len, uint64_t *rng) ;
+				/* permutes whole triplets from s[0], keeps the tail */
+extern void shuffleDinucleotides (char *s, int len, uint64_t *rng) ;
+				/* uniform over sequences with the same dinucleotide
+				   counts and first and last bases; codes 0..3 only */
+
+/***** end of file *****/
@@ -0,0 +1,226 @@
+/*  File: twobit.c
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: memory mapped random access to UCSC .2bit files
+		Layout: uint32 signature 0x1A412743, version (0 or 1),
+		sequence count, reserved; then per sequence a byte name
+		length, the name and the record offset (uint32, or uint64
+		in version 1).  Each record is uint32 dnaSize, nBlockCount,
+		nBlockStarts[], nBlockSizes[], maskBlockCount, maskBlockStarts[],
+		maskBlockSizes[], reserved, then packed bases 4 per byte,
+		first base in the high bits, T=0 C=1 A=2 G=3.
+		Bases are decoded straight to the dna2indexConv codes used
+		by readSequence.  Mask blocks only record case, which the
+		index codes do not carry, so they are skipped.
+ * Exported functions: see twobit.h
+ * HISTORY:
+ * Created: Sun Oct 18 10:04:24 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "twobit.h"
+
+#define TWOBIT_SIG 0x1A412743
+
+struct TwoBitStruct {
+  unsigned char *base ;		/* the mapped file */
+  size_t size ;
+  int isSwap ;			/* file is in the other byte order */
+  int n ;
+  char **names ;
+  uint64_t *offsets ;
+  int *byName ;			/* indices sorted by name, for twoBitFind */
+} ;
+
+static char decode[256][4] ;	/* byte -> four index codes */
+
+static void makeDecode (void)
+{
+  static int isDone = 0 ;
+  static const char code[4] = { 3, 1, 0, 2 } ; /* T C A G -> dna2indexConv */
+  int i, j ;
+
+  if (isDone) return ;
+  for (i = 0 ; i < 256 ; ++i)
+    for (j = 0 ; j < 4 ; ++j)
+      decode[i][j] = code[(i >> (6 - 2*j)) & 3] ;
+  isDone = 1 ;
+}
+
+static uint32_t get32 (TwoBit *tb, uint64_t off)
+{
+  uint32_t x ;
+
+  memcpy (&x, tb->base + off, 4) ;
+  if (tb->isSwap)
+    x = (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24) ;
+  return x ;
+}
+
+static uint64_t get64 (TwoBit *tb, uint64_t off)
+{
+  uint64_t lo = get32 (tb, off), hi = get32 (tb, off+4) ;
+
+  return tb->isSwap ? (lo << 32) | hi : (hi << 32) | lo ;
+}
+
+static TwoBit *sortNames ;	/* for qsort comparison */
+
+static int nameOrder (const void *a, const void *b)
+{
+  return strcmp (sortNames->names[*(int*)a], sortNames->names[*(int*)b]) ;
+}
+
+/*****************************************************/
+
+TwoBit *twoBitOpen (char *name)
+{
+  int fd, i, len, version ;
+  struct stat st ;
+  uint32_t sig ;
+  uint64_t off ;
+  TwoBit *tb ;
+
+  if ((fd = open (name, O_RDONLY)) < 0) return 0 ;
+  if (fstat (fd, &st) || st.st_size < 16)
+    { close (fd) ; return 0 ; }
+
+  tb = (TwoBit*) calloc (1, sizeof(TwoBit)) ;
+  tb->size = st.st_size ;
+  tb->base = (unsigned char*) mmap (0, tb->size, PROT_READ, MAP_PRIVATE, fd, 0) ;
+  close (fd) ;
+  if (tb->base == MAP_FAILED)
+    { free (tb) ; return 0 ; }
+
+  memcpy (&sig, tb->base, 4) ;
+  if (sig != TWOBIT_SIG)
+    { tb->isSwap = 1 ;
+      if (get32 (tb, 0) != TWOBIT_SIG)
+	{ munmap (tb->base, tb->size) ; free (tb) ; return 0 ; }
+    }
+  version = get32 (tb, 4) ;
+  tb->n = get32 (tb, 8) ;
+  if (version > 1)
+    { fprintf (stderr, "unsupported .2bit version %d in %s\n", version, name) ;
+      twoBitClose (tb) ; return 0 ;
+    }
+
+  tb->names = (char**) calloc (tb->n, sizeof(char*)) ;
+  tb->offsets = (uint64_t*) malloc (tb->n * sizeof(uint64_t)) ;
+  tb->byName = (int*) malloc (tb->n * sizeof(int)) ;
+  for (i = 0, off = 16 ; i < tb->n ; ++i)
+    { if (off + 1 > tb->size) break ;
+      len = tb->base[off++] ;
+      if (off + len + (version ? 8 : 4) > tb->size) break ;
+      tb->names[i] = (char*) malloc (len+1) ;
+      memcpy (tb->names[i], tb->base + off, len) ;
+      tb->names[i][len] = 0 ;
+      off += len ;
+      if (version)
+	{ tb->offsets[i] = get64 (tb, off) ; off += 8 ; }
+      else
+	{ tb->offsets[i] = get32 (tb, off) ; off += 4 ; }
+      tb->byName[i] = i ;
+    }
+  if (i < tb->n)
+    { fprintf (stderr, "truncated .2bit index in %s\n", name) ;
+      tb->n = i ;
+      twoBitClose (tb) ; return 0 ;
+    }
+
+  sortNames = tb ;
+  qsort (tb->byName, tb->n, sizeof(int), nameOrder) ;
+  makeDecode () ;
+
+  return tb ;
+}
+
+void twoBitClose (TwoBit *tb)
+{
+  int i ;
+
+  if (!tb) return ;
+  munmap (tb->base, tb->size) ;
+  for (i = 0 ; i < tb->n ; ++i)
+    free (tb->names[i]) ;
+  free (tb->names) ;
+  free (tb->offsets) ;
+  free (tb->byName) ;
+  free (tb) ;
+}
+
+int twoBitCount (TwoBit *tb) { return tb->n ; }
+
+char *twoBitName (TwoBit *tb, int i) { return tb->names[i] ; }
+
+int twoBitFind (TwoBit *tb, char *name)
+{
+  int lo = 0, hi = tb->n - 1, mid, c ;
+
+  while (lo <= hi)
+    { mid = (lo + hi) / 2 ;
+      c = strcmp (name, tb->names[tb->byName[mid]]) ;
+      if (!c) return tb->byName[mid] ;
+      if (c < 0) hi = mid - 1 ; else lo = mid + 1 ;
+    }
+  return -1 ;
+}
+
+int twoBitLength (TwoBit *tb, int i)
+{
+  if (tb->offsets[i] + 4 > tb->size) return -1 ;
+  return get32 (tb, tb->offsets[i]) ;
+}
+
+int twoBitRead (TwoBit *tb, int i, int nCode, char **seq, int *length)
+{
+  uint64_t off = tb->offsets[i], nOff ;
+  uint32_t len, nN, nMask, j, start, size ;
+  unsigned char *packed ;
+  char *s ;
+
+  if (off + 8 > tb->size) return -1 ;
+  len = get32 (tb, off) ;
+  nN = get32 (tb, off+4) ;
+  nOff = off + 8 ;		/* N block starts, then sizes */
+  off = nOff + 8*(uint64_t)nN ;
+  if (off + 4 > tb->size) return -1 ;
+  nMask = get32 (tb, off) ;
+  off += 4 + 8*(uint64_t)nMask + 4 ; /* skip mask blocks and reserved */
+  if (off + (len+3)/4 > tb->size) return -1 ;
+  packed = tb->base + off ;
+
+  if (!(s = (char*) malloc (len + 4)))
+    { fprintf (stderr, "MALLOC failure reqesting %u bytes - aborting\n", len+4) ;
+      exit (-1) ;
+    }
+  for (j = 0 ; j + 4 <= len ; j += 4)
+    memcpy (s + j, decode[*packed++], 4) ;
+  if (j < len)
+    memcpy (s + j, decode[*packed], len - j) ;
+  memset (s + len, 0, 4) ;	/* terminate, with slack for lookahead */
+
+  for (j = 0 ; j < nN ; ++j)
+    { start = get32 (tb, nOff + 4*j) ;
+      size = get32 (tb, nOff + 4*(nN + j)) ;
+      if (start > len || size > len - start)
+	{ free (s) ; return -1 ; }
+      memset (s + start, nCode, size) ;
+    }
+
+  *seq = s ;
+  if (length) *length = len ;
+  return len ;
+}
+
+/**************** end of file ***************/
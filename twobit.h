@@ -0,0 +1,29 @@
+/*  File: twobit.h
+ *  Author: agent (agent@local)
+ *  Copyright (C) 2026 agent
+ *  License: available under the MIT license as in the accompanying LICENSE file
+ *-------------------------------------------------------------------
+ * Description: memory mapped random access to UCSC .2bit files
+ * Exported functions: twoBitOpen, twoBitClose, twoBitCount, twoBitName,
+                       twoBitFind, twoBitLength, twoBitRead
+ * HISTORY:
+ * Created: Sun Oct 18 10:04:24 2026 (agent)
+ *-------------------------------------------------------------------
+ */
+
+typedef struct TwoBitStruct TwoBit ;
+
+extern TwoBit *twoBitOpen (char *name) ;
+				/* returns 0 if not a readable .2bit file */
+extern void twoBitClose (TwoBit *tb) ;
+extern int twoBitCount (TwoBit *tb) ;
+extern char *twoBitName (TwoBit *tb, int i) ;
+				/* pointer into the index - copy if keeping */
+extern int twoBitFind (TwoBit *tb, char *name) ;
+				/* index of sequence name, -1 if absent */
+extern int twoBitLength (TwoBit *tb, int i) ;
+extern int twoBitRead (TwoBit *tb, int i, int nCode, char **seq, int *length) ;
+				/* decode sequence i as dna2indexConv codes,
+				   N blocks as nCode; returns length, -1 if corrupt */
+
+/***** end of file *****/